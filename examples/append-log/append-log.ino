@@ -0,0 +1,54 @@
+#include <SD.h>
+
+#include "esp32-psram.h"
+
+// Log the values of many sensors into one file on the SD card: the records
+// are collected in PSRAM and written with one large write per 16K
+
+File logFile;
+AppendLog<PSRAMClass, File>* logger = nullptr;
+const int SENSORS = 24;
+int streams[SENSORS];
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  if (!PSRAM.begin() || !SD.begin()) {
+    Serial.println("Initialization failed!");
+    return;
+  }
+
+  // continue an existing log: the index is rebuilt from its records
+  logFile = SD.open("/sensors.log", SD.exists("/sensors.log") ? "r+" : "w+");
+  logger = new AppendLog<PSRAMClass, File>(PSRAM, logFile, 16 * 1024);
+  if (!logger->begin()) {
+    Serial.println("Could not start the log");
+    return;
+  }
+  for (int j = 0; j < SENSORS; j++) {
+    char name[16];
+    snprintf(name, sizeof(name), "sensor-%d", j);
+    streams[j] = logger->open(name);
+  }
+}
+
+void loop() {
+  static uint32_t count = 0;
+  if (logger == nullptr) return;
+
+  char line[32];
+  int sensor = count % SENSORS;
+  int len = snprintf(line, sizeof(line), "%lu;%d\n", (unsigned long)millis(),
+                     analogRead(sensor % 8));
+  logger->append(streams[sensor], (const uint8_t*)line, len);
+
+  if (++count % 10000 == 0) {
+    AppendLogStats stats = logger->stats();
+    Serial.printf("%u records in %u commits (%u bytes)\n",
+                  (unsigned)stats.records, (unsigned)stats.commits,
+                  (unsigned)stats.bytesCommitted);
+    // print the history of one sensor
+    logger->replay(streams[0], Serial);
+  }
+}
@@ -0,0 +1,75 @@
+#include <LittleFS.h>
+
+#include "esp32-psram.h"
+
+// Measures the sector throughput of RAM disks in PSRAM and HIMEM and
+// compares it with a block device which is stored in a LittleFS file.
+// This sketch is the only benchmark of the block devices in the library:
+// the host measurement of the same loops against a file on the PC needed a
+// mock of the ESP32 APIs and was not added, as the library has no host
+// build.
+
+const size_t DISK_SIZE = 1024 * 1024;
+const size_t SECTOR_SIZES[] = {512, 4096};
+
+uint8_t sector[4096];
+
+float mbPerSecond(size_t bytes, uint32_t us) {
+  return us == 0 ? 0.0f : (float)bytes / us;
+}
+
+void benchmark(const char* name, BlockDevice& disk) {
+  size_t count = disk.sectorCount();
+  size_t bytes = count * disk.sectorSize();
+
+  // sequential write
+  uint32_t start = micros();
+  for (size_t j = 0; j < count; j++) disk.writeBlock(j, sector);
+  disk.sync();
+  uint32_t writeUs = micros() - start;
+
+  // sequential read
+  start = micros();
+  for (size_t j = 0; j < count; j++) disk.readBlock(j, sector);
+  uint32_t readUs = micros() - start;
+
+  // random read
+  start = micros();
+  for (size_t j = 0; j < count; j++) disk.readBlock(random(count), sector);
+  uint32_t randomUs = micros() - start;
+
+  Serial.printf(
+      "%-8s sector %4u: write %6.2f MB/s, read %6.2f MB/s, random read "
+      "%6.2f MB/s\n",
+      name, (unsigned)disk.sectorSize(), mbPerSecond(bytes, writeUs),
+      mbPerSecond(bytes, readUs), mbPerSecond(bytes, randomUs));
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  for (size_t j = 0; j < sizeof(sector); j++) sector[j] = j;
+  LittleFS.begin(true);
+
+  for (size_t sectorSize : SECTOR_SIZES) {
+    size_t count = DISK_SIZE / sectorSize;
+
+    RamBlockDevicePSRAM psram(sectorSize);
+    if (psram.begin(count)) benchmark("PSRAM", psram);
+
+    RamBlockDeviceHIMEM himem(sectorSize);
+    if (himem.begin(count)) benchmark("HIMEM", himem);
+
+    // file based stand-in
+    File file = LittleFS.open("/disk.img", "w+");
+    FileBlockDevice<File> flash(file, sectorSize);
+    if (flash.begin(count)) benchmark("LittleFS", flash);
+    file.close();
+    LittleFS.remove("/disk.img");
+  }
+}
+
+void loop() {
+  // Nothing here
+}
@@ -0,0 +1,51 @@
+#include <SD.h>
+
+#include "esp32-psram.h"
+
+// Log to a SD card without stalling the producer: the data is buffered in
+// PSRAM and written to the card in 4K chunks by a background task
+
+File logFile;
+CachedFilePSRAM* cache = nullptr;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  if (!SD.begin()) {
+    Serial.println("SD initialization failed!");
+    return;
+  }
+
+  logFile = SD.open("/log.txt", FILE_APPEND);
+  // buffer up to 256K, so that latency spikes of the card are absorbed
+  cache = new CachedFilePSRAM(logFile, 256 * 1024, 4096);
+  cache->setPosition(logFile.size());
+  // don't block the producer for more than 10 ms
+  cache->setWriteTimeout(10);
+  if (!cache->begin()) {
+    Serial.println("Could not start the cache");
+  }
+}
+
+void loop() {
+  static uint32_t count = 0;
+  static uint32_t maxWriteUs = 0;
+  if (cache == nullptr) return;
+
+  uint32_t start = micros();
+  cache->printf("%lu: sample %u\n", (unsigned long)millis(), (unsigned)count);
+  uint32_t duration = micros() - start;
+  if (duration > maxWriteUs) maxWriteUs = duration;
+
+  if (++count % 10000 == 0) {
+    CacheStats stats = cache->stats();
+    Serial.printf(
+        "written %u bytes, dropped %u, SD write avg %u us max %u us, "
+        "producer max %u us\n",
+        (unsigned)stats.bytesWritten, (unsigned)stats.bytesDropped,
+        (unsigned)stats.averageLatencyUs(), (unsigned)stats.maxLatencyUs,
+        (unsigned)maxWriteUs);
+  }
+  delayMicroseconds(100);
+}
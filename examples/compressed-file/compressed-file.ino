@@ -0,0 +1,47 @@
+#include "esp32-psram.h"
+
+// Store JSON log records compressed in PSRAM: each 16K block is compressed
+// with LZ4 as soon as it is full
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  if (!PSRAM.begin()) {
+    Serial.println("PSRAM initialization failed!");
+    return;
+  }
+
+  CompressedFilePSRAM log(16 * 1024);
+  log.open(PSRAM.open("/log.json.lz4", FILE_WRITE), FileMode::WRITE);
+  uint32_t start = millis();
+  for (int j = 0; j < 20000; j++) {
+    log.printf("{\"id\":%d,\"time\":%lu,\"temperature\":%d.%d}\n", j,
+               (unsigned long)millis(), 20 + j % 5, j % 10);
+  }
+  log.close();
+  Serial.printf("Wrote in %lu ms\n", (unsigned long)(millis() - start));
+
+  // random access: only the block with the position is decompressed
+  log.open(PSRAM.open("/log.json.lz4", FILE_READ), FileMode::READ);
+  Serial.printf("%u bytes stored in %u bytes\n", (unsigned)log.size(),
+                (unsigned)log.storedSize());
+  log.seek(log.size() / 2);
+  log.readStringUntil('\n');
+  Serial.println(log.readStringUntil('\n'));
+
+  // sequential read
+  log.seek(0);
+  start = millis();
+  char buffer[512];
+  size_t total = 0;
+  while (log.available() > 0) {
+    total += log.readBytes(buffer, sizeof(buffer));
+  }
+  Serial.printf("Read %u bytes in %lu ms\n", (unsigned)total,
+                (unsigned long)(millis() - start));
+}
+
+void loop() {
+  // Nothing here
+}
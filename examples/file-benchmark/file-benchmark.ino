@@ -0,0 +1,54 @@
+#include "esp32-psram.h"
+
+// Measures the sequential write and read throughput of FilePSRAM and
+// FileHIMEM with different chunk sizes
+
+const size_t FILE_SIZE = 1024 * 1024;
+const size_t CHUNK_SIZES[] = {1, 64, 512, 4096};
+
+uint8_t chunk[4096];
+
+float mbPerSecond(size_t bytes, uint32_t us) {
+  return us == 0 ? 0.0f : (float)bytes / us;
+}
+
+template <typename File>
+void benchmark(const char* name, size_t chunkSize) {
+  File file;
+  file.reserve(FILE_SIZE);
+
+  // write
+  file.open(FileMode::WRITE);
+  uint32_t start = micros();
+  for (size_t total = 0; total < FILE_SIZE; total += chunkSize) {
+    file.write(chunk, chunkSize);
+  }
+  uint32_t writeUs = micros() - start;
+
+  // read
+  file.open(FileMode::READ);
+  start = micros();
+  while (file.readBytes((char*)chunk, chunkSize) > 0) {
+  }
+  uint32_t readUs = micros() - start;
+
+  Serial.printf("%-6s chunk %5u: write %7.2f MB/s, read %7.2f MB/s\n", name,
+                (unsigned)chunkSize, mbPerSecond(FILE_SIZE, writeUs),
+                mbPerSecond(FILE_SIZE, readUs));
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  for (size_t j = 0; j < sizeof(chunk); j++) chunk[j] = j;
+
+  for (size_t chunkSize : CHUNK_SIZES) {
+    benchmark<FilePSRAM>("PSRAM", chunkSize);
+    benchmark<FileHIMEM>("HIMEM", chunkSize);
+  }
+}
+
+void loop() {
+  // Nothing here
+}
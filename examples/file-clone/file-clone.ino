@@ -0,0 +1,41 @@
+#include "esp32-psram.h"
+
+// Clone a large file and freeze a log without copying the data: the files
+// share their pages until one of them is changed
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  if (!PSRAM.begin()) {
+    Serial.println("PSRAM initialization failed!");
+    return;
+  }
+
+  uint8_t buffer[1024];
+  for (size_t j = 0; j < sizeof(buffer); j++) buffer[j] = j;
+  FilePSRAM file = PSRAM.open("/data.bin", FILE_WRITE);
+  for (int j = 0; j < 2048; j++) file.write(buffer, sizeof(buffer));
+  file.close();
+  Serial.printf("Used: %u bytes\n", (unsigned)PSRAM.usedBytes());
+
+  uint32_t start = micros();
+  PSRAM.clone("/data.bin", "/backup/data.bin");
+  Serial.printf("Clone in %lu us, used: %u bytes\n",
+                (unsigned long)(micros() - start),
+                (unsigned)PSRAM.usedBytes());
+
+  // a consistent state of the file while it is changed
+  FilePSRAM frozen = PSRAM.snapshot("/data.bin");
+  file = PSRAM.open("/data.bin", FILE_APPEND);
+  file.print("more data");
+  file.close();
+  Serial.printf("Snapshot: %u bytes, file: %u bytes, used: %u bytes\n",
+                (unsigned)frozen.size(),
+                (unsigned)PSRAM.open("/data.bin", FILE_READ).size(),
+                (unsigned)PSRAM.usedBytes());
+}
+
+void loop() {
+  // Nothing here
+}
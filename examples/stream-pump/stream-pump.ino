@@ -0,0 +1,40 @@
+#include "esp32-psram.h"
+
+// Copy a file from PSRAM to Serial and buffer data in a ring buffer
+// without per-byte read()/write() loops
+StreamPump pumper;
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  if (!PSRAM.begin()) {
+    Serial.println("PSRAM initialization failed!");
+    return;
+  }
+
+  // Create a test file
+  auto file = PSRAM.open("log.txt", FILE_WRITE);
+  for (int i = 0; i < 100; i++) {
+    file.printf("Log line %d\n", i);
+  }
+  file.close();
+
+  // File -> ring buffer: the data is written straight from the file storage
+  RingBufferStreamPSRAM ring(4096);
+  file = PSRAM.open("log.txt", FILE_READ);
+  PumpResult result = pumper.pump(file, ring);
+  Serial.printf("Copied %u bytes to the ring buffer (%.0f bytes/s)\n",
+                (unsigned)result.bytes, result.bytesPerSecond());
+
+  // Ring buffer -> Serial: the data is written from the ring segments
+  result = pumper.pump(ring, Serial);
+  Serial.printf("\nCopied %u bytes to Serial (%.0f bytes/s)\n",
+                (unsigned)result.bytes, result.bytesPerSecond());
+}
+
+void loop() {
+  // Serial -> ring buffer, e.g. to decouple a slow consumer
+  static RingBufferStreamPSRAM input(1024);
+  pumper.pump(Serial, input);
+}
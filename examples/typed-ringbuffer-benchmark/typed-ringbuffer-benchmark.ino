@@ -0,0 +1,53 @@
+#include "esp32-psram.h"
+
+// Compares the per-element cost of push()/pop() loops with the bulk
+// pushN()/popN() API for a sensor task that produces 256 samples per tick
+
+const size_t SAMPLES_PER_TICK = 256;
+const size_t CAPACITY = 16 * 1024;
+const int TICKS = 200;
+
+int16_t samples[SAMPLES_PER_TICK];
+
+template <typename RingBuffer>
+void benchmark(const char* name, RingBuffer& buffer) {
+  // element by element
+  uint32_t start = micros();
+  for (int tick = 0; tick < TICKS; tick++) {
+    for (size_t j = 0; j < SAMPLES_PER_TICK; j++) buffer.push(samples[j]);
+    for (size_t j = 0; j < SAMPLES_PER_TICK; j++) buffer.pop(samples[j]);
+  }
+  uint32_t loopUs = micros() - start;
+
+  // bulk
+  start = micros();
+  for (int tick = 0; tick < TICKS; tick++) {
+    buffer.pushN(samples, SAMPLES_PER_TICK);
+    buffer.popN(samples, SAMPLES_PER_TICK);
+  }
+  uint32_t bulkUs = micros() - start;
+
+  float elements = 2.0f * TICKS * SAMPLES_PER_TICK;
+  Serial.printf("%-6s push/pop: %7.3f us/element, pushN/popN: %7.3f us/element\n",
+                name, loopUs / elements, bulkUs / elements);
+}
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  for (size_t j = 0; j < SAMPLES_PER_TICK; j++) samples[j] = j;
+
+  TypedRingBufferRAM<int16_t> ram(CAPACITY);
+  benchmark("RAM", ram);
+
+  TypedRingBufferPSRAM<int16_t> psram(CAPACITY);
+  benchmark("PSRAM", psram);
+
+  TypedRingBufferHIMEM<int16_t> himem(CAPACITY);
+  benchmark("HIMEM", himem);
+}
+
+void loop() {
+  // Nothing here
+}
@@ -0,0 +1,28 @@
+#include "esp32-psram.h"
+
+// Moving statistics over the last 10000 samples, updated in O(1) per sample
+WindowedStatsPSRAM<float> stats(10000);
+
+void setup() {
+  Serial.begin(115200);
+  while (!Serial) delay(10);
+
+  // optional: estimate percentiles with 200 bins in the range 0 - 100
+  stats.setHistogram(0.0, 100.0, 200);
+}
+
+void loop() {
+  // simulated sensor reading
+  float value = 50.0f + random(-200, 200) / 10.0f;
+  stats.add(value);
+
+  static uint32_t lastPrint = 0;
+  if (millis() - lastPrint > 1000) {
+    lastPrint = millis();
+    Serial.printf("n=%u mean=%.2f stddev=%.2f min=%.1f max=%.1f median=%.1f p95=%.1f\n",
+                  (unsigned)stats.count(), stats.mean(), stats.stddev(),
+                  stats.minimum(), stats.maximum(), stats.percentile(50),
+                  stats.percentile(95));
+  }
+  delay(1);
+}
@@ -16,8 +16,17 @@
 #include "esp32-psram/InMemoryFile.h"    // File interface using vectors
 #include "esp32-psram/PSRAM.h"         // PSRAM file system
 #include "esp32-psram/HIMEM.h"         // HIMEM file system
+#include "esp32-psram/BlockDevice.h"   // RAM disk for FatFs or LittleFS
+#include "esp32-psram/CachedFile.h"    // Write-behind cache for slow files
+#include "esp32-psram/AppendLog.h"     // Group-commit log for many streams
+#include "esp32-psram/CompressedFile.h" // LZ4 compressed files
 #include "esp32-psram/RingBufferStream.h" // Stream-based ring buffer
 #include "esp32-psram/TypedRingBuffer.h" // Typed ring buffer for structured data
+#include "esp32-psram/StaticRingBuffer.h" // Fixed-capacity ring buffer with static storage
+#include "esp32-psram/TimedRingBuffer.h" // Time-ordered ring buffer
+#include "esp32-psram/WindowedStats.h" // Sliding-window statistics
+#include "esp32-psram/MultiResolutionHistory.h" // Downsampled history tiers
+#include "esp32-psram/StreamPump.h"    // Chunked copying between streams
 
 #ifndef ESP32_PSRAM_NO_NAMESPACE
 using namespace esp32_psram;
@@ -0,0 +1,518 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <stdint.h>
+
+#include <string>
+#include <utility>
+
+#include "AllocatorPSRAM.h"
+#include "BinaryFormat.h"
+#include "InMemoryFS.h"
+#include "VectorPSRAM.h"
+
+namespace esp32_psram {
+
+/**
+ * @brief Record format of an AppendLog
+ *
+ * Each record is a header followed by the payload. All numbers are little
+ * endian:
+ * - header (12 bytes): magic (1 byte, 0xA5), type (1 byte, 0 = data,
+ *   1 = name of a new stream), stream id (2 bytes), length of the payload
+ *   (4 bytes), CRC-32 of the first 8 header bytes and the payload (4 bytes)
+ * - payload: the appended data, or the name of the stream
+ *
+ * Stream ids are assigned in the order of the name records, starting at 0.
+ */
+namespace appendlog {
+constexpr uint8_t kMagic = 0xA5;
+constexpr uint8_t kTypeData = 0;
+constexpr uint8_t kTypeName = 1;
+constexpr size_t kHeaderSize = 12;
+constexpr uint16_t kMaxStreams = 0xFFFF;
+/// Size of the buffer which is used to read from the target
+constexpr size_t kCopyBufferSize = 512;
+}  // namespace appendlog
+
+/**
+ * @struct AppendLogStats
+ * @brief Statistics of an AppendLog
+ */
+struct AppendLogStats {
+  /// Number of appended records
+  uint32_t records = 0;
+  /// Number of group writes to the target
+  uint32_t commits = 0;
+  /// Number of bytes (headers and payloads) written to the target
+  size_t bytesCommitted = 0;
+};
+
+/**
+ * @class AppendLog
+ * @brief Append-only log which combines many logical streams into a single
+ * file, written with few large group commits
+ * @tparam FileSystem The file system of the staging buffers (PSRAMClass or
+ * HIMEMClass)
+ * @tparam Target Seekable file type of the log, like fs::File
+ *
+ * append() adds a record with a header (see appendlog) to a staging file in
+ * the InMemoryFS, so appending costs a copy into PSRAM. commit() writes all
+ * staged records with one sequential write to the target and flushes it. A
+ * commit happens automatically when the staged records reach the group
+ * size. Two staging files are used, so appends continue while a commit
+ * writes to the target.
+ *
+ * An index in PSRAM links the records of each stream, so replay() copies
+ * the content of one stream without scanning the log. begin() rebuilds the
+ * index from the records in the target; the log continues after the last
+ * valid record, so a record which was torn by a reset is overwritten. For
+ * this the target must be opened for reading and writing without append
+ * mode (e.g. "r+" or "w+").
+ */
+template <typename FileSystem, typename Target>
+class AppendLog {
+ public:
+  using FileType =
+      decltype(std::declval<FileSystem&>().open("", FILE_WRITE));
+
+  /**
+   * @brief Constructor
+   * @param fs The file system for the staging files
+   * @param target The log file
+   * @param groupSize Staged bytes which trigger a commit
+   */
+  AppendLog(FileSystem& fs, Target& target, size_t groupSize = 16 * 1024)
+      : fs(fs), target(target), group_size(groupSize) {
+    lock = xSemaphoreCreateMutex();
+    commit_lock = xSemaphoreCreateMutex();
+  }
+
+  AppendLog(const AppendLog&) = delete;
+  AppendLog& operator=(const AppendLog&) = delete;
+
+  ~AppendLog() {
+    if (lock != nullptr) vSemaphoreDelete(lock);
+    if (commit_lock != nullptr) vSemaphoreDelete(commit_lock);
+  }
+
+  /**
+   * @brief Create the staging files and build the index from the records
+   * which are already in the target
+   * @param directory Directory of the staging files in the file system
+   * @return true if successful
+   */
+  bool begin(const char* directory = "/appendlog") {
+    if (lock == nullptr || commit_lock == nullptr) return false;
+    MutexGuard commitGuard(commit_lock);
+    MutexGuard guard(lock);
+    streams.clear();
+    records.clear();
+    statistics = AppendLogStats();
+    failed = false;
+    for (int j = 0; j < 2; j++) {
+      path[j] = directory;
+      path[j] += j == 0 ? "/0" : "/1";
+      staging[j] = fs.open(path[j].c_str(), FILE_WRITE);
+      if (!staging[j]) {
+        ESP_LOGE(TAG, "could not create %s", path[j].c_str());
+        return false;
+      }
+      staging[j].open(FileMode::READ_WRITE);
+    }
+    front_index = 0;
+    in_flight = 0;
+    committed = scan();
+    return true;
+  }
+
+  /**
+   * @brief Commit the staged records and remove the staging files
+   * @return true if all records were written
+   */
+  bool end() {
+    bool result = commit();
+    MutexGuard commitGuard(commit_lock);
+    MutexGuard guard(lock);
+    for (int j = 0; j < 2; j++) {
+      staging[j].close();
+      staging[j] = FileType();
+      fs.remove(path[j].c_str());
+    }
+    return result;
+  }
+
+  /**
+   * @brief Get the id of a stream, the stream is created if it does not exist
+   * @param name Name of the stream
+   * @return The id, -1 if the stream could not be created
+   */
+  int open(const char* name) {
+    MutexGuard guard(lock);
+    int id = findLocked(name);
+    if (id >= 0) return id;
+    if (failed || streams.size() >= appendlog::kMaxStreams) return -1;
+    id = streams.size();
+    size_t len = strlen(name);
+    if (stage(appendlog::kTypeName, id, (const uint8_t*)name, len) ==
+        SIZE_MAX) {
+      return -1;
+    }
+    StreamInfo info;
+    info.name.assign(name, len);
+    streams.push_back(info);
+    return id;
+  }
+
+  /**
+   * @brief Get the id of an existing stream
+   * @param name Name of the stream
+   * @return The id, -1 if there is no such stream
+   */
+  int find(const char* name) {
+    MutexGuard guard(lock);
+    return findLocked(name);
+  }
+
+  /**
+   * @brief Append a record to a stream
+   * @param id Id of the stream
+   * @param data The data
+   * @param len Number of bytes
+   * @return len, 0 if the record could not be staged
+   */
+  size_t append(int id, const uint8_t* data, size_t len) {
+    bool full;
+    {
+      MutexGuard guard(lock);
+      if (failed || id < 0 || (size_t)id >= streams.size()) return 0;
+      size_t offset = stage(appendlog::kTypeData, id, data, len);
+      if (offset == SIZE_MAX) return 0;
+      addRecord(id, offset, len);
+      full = staging[front_index].size() >= group_size;
+    }
+    if (full) commit();
+    return len;
+  }
+
+  /**
+   * @brief Append a string as record to a stream
+   */
+  size_t append(int id, const char* str) {
+    return append(id, (const uint8_t*)str, strlen(str));
+  }
+
+  /**
+   * @brief Write all staged records to the target with one group write and
+   * flush the target
+   * @return true if successful
+   */
+  bool commit() {
+    MutexGuard commitGuard(commit_lock);
+    FileType* back;
+    {
+      MutexGuard guard(lock);
+      if (failed) return false;
+      back = &staging[front_index];
+      if (back->size() == 0) return true;
+      front_index ^= 1;
+      in_flight = back->size();
+    }
+
+    // the target is written without lock: appends continue in the other file
+    size_t written = 0;
+    if (target.seek(committed)) {
+      back->seek(0);
+      written = back->writeTo(target);
+      target.flush();
+    }
+    back->seek(0);
+    back->truncate();
+
+    MutexGuard guard(lock);
+    bool ok = written == in_flight;
+    if (!ok) {
+      ESP_LOGE(TAG, "commit failed: %u of %u bytes written", (unsigned)written,
+               (unsigned)in_flight);
+      failed = true;
+    }
+    statistics.commits++;
+    statistics.bytesCommitted += written;
+    committed += in_flight;
+    in_flight = 0;
+    return ok;
+  }
+
+  /**
+   * @brief Copy the content of all records of a stream in the order they
+   * were appended, including the staged records
+   * @param id Id of the stream
+   * @param out Destination
+   * @return Number of bytes copied
+   */
+  size_t replay(int id, Print& out) {
+    // no commit while the records are read: each one is in the target or in
+    // the front staging file
+    MutexGuard commitGuard(commit_lock);
+    uint32_t index;
+    {
+      MutexGuard guard(lock);
+      if (id < 0 || (size_t)id >= streams.size()) return 0;
+      index = streams[id].first;
+    }
+    uint8_t buffer[appendlog::kCopyBufferSize];
+    size_t total = 0;
+    while (index != kNone) {
+      Record record;
+      {
+        MutexGuard guard(lock);
+        record = records[index];
+      }
+      for (size_t done = 0; done < record.length;) {
+        size_t n = std::min(record.length - done, sizeof(buffer));
+        if (readLog(record.offset + done, buffer, n) != n) {
+          ESP_LOGE(TAG, "replay failed at offset %u",
+                   (unsigned)(record.offset + done));
+          return total;
+        }
+        size_t written = out.write(buffer, n);
+        total += written;
+        if (written < n) return total;
+        done += n;
+      }
+      index = record.next;
+    }
+    return total;
+  }
+
+  /**
+   * @brief Get the number of streams
+   */
+  size_t streamCount() {
+    MutexGuard guard(lock);
+    return streams.size();
+  }
+
+  /**
+   * @brief Get the name of a stream
+   * @param id Id of the stream
+   * @return The name, empty for an invalid id
+   */
+  String name(int id) {
+    MutexGuard guard(lock);
+    if (id < 0 || (size_t)id >= streams.size()) return String();
+    return String(streams[id].name.c_str());
+  }
+
+  /**
+   * @brief Get the number of records of a stream
+   */
+  size_t recordCount(int id) {
+    MutexGuard guard(lock);
+    if (id < 0 || (size_t)id >= streams.size()) return 0;
+    return streams[id].count;
+  }
+
+  /**
+   * @brief Get the number of payload bytes of a stream
+   */
+  size_t size(int id) {
+    MutexGuard guard(lock);
+    if (id < 0 || (size_t)id >= streams.size()) return 0;
+    return streams[id].bytes;
+  }
+
+  /**
+   * @brief Get the size of the log including the staged records
+   * @return Size in bytes
+   */
+  size_t size() {
+    MutexGuard guard(lock);
+    return committed + in_flight + staging[front_index].size();
+  }
+
+  /**
+   * @brief Get the number of bytes which are not committed yet
+   */
+  size_t pending() {
+    MutexGuard guard(lock);
+    return in_flight + staging[front_index].size();
+  }
+
+  /**
+   * @brief Get the statistics
+   */
+  AppendLogStats stats() {
+    MutexGuard guard(lock);
+    return statistics;
+  }
+
+ protected:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  /// Position and length of the payload of a data record
+  struct Record {
+    size_t offset;
+    size_t length;
+    uint32_t next;  // next record of the same stream
+  };
+
+  using Name =
+      std::basic_string<char, std::char_traits<char>, AllocatorPSRAM<char>>;
+
+  struct StreamInfo {
+    Name name;
+    uint32_t first = kNone;
+    uint32_t last = kNone;
+    size_t count = 0;
+    size_t bytes = 0;
+  };
+
+  FileSystem& fs;
+  Target& target;
+  size_t group_size;
+  String path[2];
+  FileType staging[2];
+  int front_index = 0;  // staging file which receives the records
+  size_t committed = 0;  // size of the log in the target
+  size_t in_flight = 0;  // bytes which a commit is writing
+  bool failed = false;
+  VectorPSRAM<StreamInfo> streams;
+  VectorPSRAM<Record> records;
+  AppendLogStats statistics;
+  // FreeRTOS mutexes: waiting tasks sleep while a commit writes to the target
+  SemaphoreHandle_t lock = nullptr;  // protects the fields above
+  SemaphoreHandle_t commit_lock = nullptr;  // serializes the target access
+  static constexpr const char* TAG = "AppendLog";
+
+  /**
+   * @brief Holds a mutex for the lifetime of the guard
+   */
+  class MutexGuard {
+   public:
+    explicit MutexGuard(SemaphoreHandle_t mutex) : mutex(mutex) {
+      if (mutex != nullptr) xSemaphoreTake(mutex, portMAX_DELAY);
+    }
+    ~MutexGuard() {
+      if (mutex != nullptr) xSemaphoreGive(mutex);
+    }
+    MutexGuard(const MutexGuard&) = delete;
+    MutexGuard& operator=(const MutexGuard&) = delete;
+
+   private:
+    SemaphoreHandle_t mutex;
+  };
+
+  int findLocked(const char* name) {
+    for (size_t j = 0; j < streams.size(); j++) {
+      if (streams[j].name == name) return j;
+    }
+    return -1;
+  }
+
+  /**
+   * @brief Add a record to the front staging file
+   * @return Position of the payload in the log, SIZE_MAX if the staging file
+   * is full
+   */
+  size_t stage(uint8_t type, uint16_t id, const uint8_t* data, size_t len) {
+    FileType& front = staging[front_index];
+    uint8_t header[appendlog::kHeaderSize];
+    header[0] = appendlog::kMagic;
+    header[1] = type;
+    binary::storeNumber(header + 2, id, 2);
+    binary::storeNumber(header + 4, len, 4);
+    uint32_t crc = binary::crc32(0, header, 8);
+    binary::storeNumber(header + 8, binary::crc32(crc, data, len), 4);
+    size_t start = front.size();
+    if (front.write(header, sizeof(header)) != sizeof(header) ||
+        front.write(data, len) != len) {
+      ESP_LOGE(TAG, "staging file full");
+      front.seek(start);
+      front.truncate();
+      return SIZE_MAX;
+    }
+    return committed + in_flight + start + sizeof(header);
+  }
+
+  void addRecord(uint16_t id, size_t offset, size_t len) {
+    StreamInfo& info = streams[id];
+    uint32_t index = records.size();
+    records.push_back(Record{offset, len, kNone});
+    if (info.last == kNone) {
+      info.first = index;
+    } else {
+      records[info.last].next = index;
+    }
+    info.last = index;
+    info.count++;
+    info.bytes += len;
+    statistics.records++;
+  }
+
+  /**
+   * @brief Read a range of the log from the target or the front staging file
+   */
+  size_t readLog(size_t offset, uint8_t* data, size_t len) {
+    if (offset >= committed) {
+      return staging[front_index].pread(data, len, offset - committed);
+    }
+    if (!target.seek(offset)) return 0;
+    return target.readBytes(reinterpret_cast<char*>(data), len);
+  }
+
+  /**
+   * @brief Build the index from the records in the target
+   * @return Position after the last valid record
+   */
+  size_t scan() {
+    size_t size = target.size();
+    size_t pos = 0;
+    uint8_t header[appendlog::kHeaderSize];
+    uint8_t buffer[appendlog::kCopyBufferSize];
+    while (size - pos >= sizeof(header)) {
+      if (!target.seek(pos) ||
+          target.readBytes(reinterpret_cast<char*>(header), sizeof(header)) !=
+              sizeof(header) ||
+          header[0] != appendlog::kMagic) {
+        break;
+      }
+      uint8_t type = header[1];
+      uint16_t id = binary::loadNumber(header + 2, 2);
+      size_t len = binary::loadNumber(header + 4, 4);
+      if (len > size - pos - sizeof(header)) break;
+      bool valid = type == appendlog::kTypeName ? id == streams.size()
+                                                : id < streams.size();
+      if (!valid) break;
+      StreamInfo info;
+      uint32_t crc = binary::crc32(0, header, 8);
+      size_t done = 0;
+      while (done < len) {
+        size_t n = std::min(len - done, sizeof(buffer));
+        if (target.readBytes(reinterpret_cast<char*>(buffer), n) != n) break;
+        crc = binary::crc32(crc, buffer, n);
+        if (type == appendlog::kTypeName) {
+          info.name.append(reinterpret_cast<char*>(buffer), n);
+        }
+        done += n;
+      }
+      if (done < len || crc != binary::loadNumber(header + 8, 4)) break;
+      if (type == appendlog::kTypeName) {
+        streams.push_back(info);
+      } else {
+        addRecord(id, pos + sizeof(header), len);
+      }
+      pos += sizeof(header) + len;
+    }
+    if (pos < size) {
+      ESP_LOGW(TAG, "ignoring %u bytes after the last valid record",
+               (unsigned)(size - pos));
+    }
+    statistics.records = 0;
+    return pos;
+  }
+};
+
+}  // namespace esp32_psram
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#if __has_include(<esp_rom_crc.h>)
+#include <esp_rom_crc.h>
+#endif
+
+namespace esp32_psram {
+
+/**
+ * @brief Helpers for the binary formats of the library (file system images,
+ * append logs and compressed files): little endian numbers and CRC-32
+ */
+namespace binary {
+
+/**
+ * @brief Update a CRC-32 (IEEE 802.3, as used by zlib)
+ * @param crc The CRC of the preceding data (0 to start)
+ * @param data The data
+ * @param len The number of bytes
+ * @return The CRC including the data
+ */
+inline uint32_t crc32(uint32_t crc, const uint8_t* data, size_t len) {
+#if __has_include(<esp_rom_crc.h>)
+  return esp_rom_crc32_le(crc, data, len);
+#else
+  struct Table {
+    uint32_t values[256];
+    Table() {
+      for (uint32_t j = 0; j < 256; j++) {
+        uint32_t value = j;
+        for (int bit = 0; bit < 8; bit++) {
+          value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+        }
+        values[j] = value;
+      }
+    }
+  };
+  static const Table table;
+  crc = ~crc;
+  for (size_t j = 0; j < len; j++) {
+    crc = table.values[(crc ^ data[j]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+#endif
+}
+
+/**
+ * @brief Store a little endian number in a buffer
+ * @param dest The buffer
+ * @param value The number
+ * @param bytes The number of bytes (max 4)
+ */
+inline void storeNumber(uint8_t* dest, uint32_t value, size_t bytes) {
+  for (size_t j = 0; j < bytes; j++) dest[j] = (value >> (8 * j)) & 0xFF;
+}
+
+/**
+ * @brief Get a little endian number from a buffer
+ * @param src The buffer
+ * @param bytes The number of bytes (max 4)
+ * @return The number
+ */
+inline uint32_t loadNumber(const uint8_t* src, size_t bytes) {
+  uint32_t value = 0;
+  for (size_t j = 0; j < bytes; j++) value |= uint32_t(src[j]) << (8 * j);
+  return value;
+}
+
+/**
+ * @brief Read a little endian number from a stream
+ * @return true if all bytes were read
+ */
+inline bool readNumber(Stream& in, uint32_t& value, size_t bytes) {
+  uint8_t data[4];
+  if (in.readBytes(data, bytes) != bytes) return false;
+  value = loadNumber(data, bytes);
+  return true;
+}
+}  // namespace binary
+
+}  // namespace esp32_psram
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "PagedVector.h"
+#include "VectorAccess.h"
+
+namespace esp32_psram {
+
+/**
+ * @class BlockDevice
+ * @brief Sector based storage, the layer below a file system like FatFs or
+ * LittleFS
+ *
+ * The operations map directly to the driver callbacks of these file
+ * systems:
+ * - FatFs: disk_read() -> readBlock(), disk_write() -> writeBlock(),
+ *   disk_ioctl(): GET_SECTOR_COUNT -> sectorCount(), GET_SECTOR_SIZE ->
+ *   sectorSize(), CTRL_SYNC -> sync(), CTRL_TRIM -> erase()
+ * - LittleFS (lfs_config): read -> read(), prog -> program(), erase ->
+ *   erase(), sync -> sync(), block_size = sectorSize(), block_count =
+ *   sectorCount()
+ *
+ * All methods return false if the range is outside the device.
+ */
+class BlockDevice {
+ public:
+  virtual ~BlockDevice() = default;
+
+  /**
+   * @brief Get the size of a sector
+   * @return Sector size in bytes
+   */
+  virtual size_t sectorSize() const = 0;
+
+  /**
+   * @brief Get the number of sectors
+   * @return Number of sectors
+   */
+  virtual size_t sectorCount() const = 0;
+
+  /**
+   * @brief Get the capacity
+   * @return Size in bytes
+   */
+  uint64_t size() const { return uint64_t(sectorSize()) * sectorCount(); }
+
+  /**
+   * @brief Read part of a sector
+   * @param sector The sector
+   * @param offset The offset in the sector (the range may continue into the
+   * following sectors)
+   * @param buffer Destination buffer
+   * @param len Number of bytes
+   * @return true if successful
+   */
+  virtual bool read(uint32_t sector, size_t offset, uint8_t* buffer,
+                    size_t len) = 0;
+
+  /**
+   * @brief Write part of a sector
+   * @param sector The sector
+   * @param offset The offset in the sector (the range may continue into the
+   * following sectors)
+   * @param buffer Source buffer
+   * @param len Number of bytes
+   * @return true if successful
+   */
+  virtual bool program(uint32_t sector, size_t offset, const uint8_t* buffer,
+                       size_t len) = 0;
+
+  /**
+   * @brief Erase sectors: they read as 0xFF afterwards
+   * @param sector The first sector
+   * @param count Number of sectors
+   * @return true if successful
+   */
+  virtual bool erase(uint32_t sector, uint32_t count = 1) = 0;
+
+  /**
+   * @brief Write cached data to the storage
+   * @return true if successful
+   */
+  virtual bool sync() { return true; }
+
+  /**
+   * @brief Read whole sectors
+   * @param sector The first sector
+   * @param buffer Destination buffer for count * sectorSize() bytes
+   * @param count Number of sectors
+   * @return true if successful
+   */
+  bool readBlock(uint32_t sector, uint8_t* buffer, uint32_t count = 1) {
+    return read(sector, 0, buffer, count * sectorSize());
+  }
+
+  /**
+   * @brief Write whole sectors
+   * @param sector The first sector
+   * @param buffer Source buffer with count * sectorSize() bytes
+   * @param count Number of sectors
+   * @return true if successful
+   */
+  bool writeBlock(uint32_t sector, const uint8_t* buffer, uint32_t count = 1) {
+    return program(sector, 0, buffer, count * sectorSize());
+  }
+
+ protected:
+  /**
+   * @brief Determine the byte position of a range and check the bounds
+   */
+  bool locate(uint32_t sector, size_t offset, size_t len, size_t& pos) const {
+    uint64_t start = uint64_t(sector) * sectorSize() + offset;
+    if (start > size() || len > size() - start) return false;
+    pos = start;
+    return true;
+  }
+};
+
+/**
+ * @class RamBlockDevice
+ * @brief Block device (RAM disk) in PSRAM or HIMEM
+ * @tparam Storage Paged byte storage: PagedVectorPSRAM or PagedVectorHIMEM
+ *
+ * The sector size is a power of two which divides the page size of the
+ * storage, so a sector never crosses a page: for HIMEM each sector access
+ * maps exactly one 32K window and copies directly from it.
+ *
+ * The device is not synchronized: file systems serialize the access to
+ * their driver.
+ */
+template <typename Storage>
+class RamBlockDevice : public BlockDevice {
+ public:
+  /**
+   * @brief Constructor
+   * @param sectorSize Size of a sector (e.g. 512 for FatFs, 4096 for
+   * LittleFS)
+   */
+  explicit RamBlockDevice(size_t sectorSize = 512) : sector_size(sectorSize) {}
+
+  /**
+   * @brief Allocate the storage; all sectors read as 0
+   * @param sectorCount Number of sectors
+   * @return true if the storage could be allocated
+   */
+  bool begin(size_t sectorCount) {
+    if (sector_size == 0 || (sector_size & (sector_size - 1)) != 0 ||
+        Storage::pageSize() % sector_size != 0) {
+      ESP_LOGE(TAG, "sector size %u must be a power of two dividing %u",
+               (unsigned)sector_size, (unsigned)Storage::pageSize());
+      return false;
+    }
+    storage.clear();
+    storage.resize(sectorCount * sector_size);
+    if (storage.size() != sectorCount * sector_size) {
+      ESP_LOGE(TAG, "allocation failed");
+      storage.clear();
+      return false;
+    }
+    sector_count = sectorCount;
+    return true;
+  }
+
+  /**
+   * @brief Release the storage
+   */
+  void end() {
+    storage.clear();
+    sector_count = 0;
+  }
+
+  size_t sectorSize() const override { return sector_size; }
+
+  size_t sectorCount() const override { return sector_count; }
+
+  bool read(uint32_t sector, size_t offset, uint8_t* buffer,
+            size_t len) override {
+    size_t pos;
+    if (!locate(sector, offset, len, pos)) return false;
+    return storage.read(buffer, pos, len) == len;
+  }
+
+  bool program(uint32_t sector, size_t offset, const uint8_t* buffer,
+               size_t len) override {
+    size_t pos;
+    if (!locate(sector, offset, len, pos)) return false;
+    return storage.write(buffer, pos, len) == len;
+  }
+
+  bool erase(uint32_t sector, uint32_t count = 1) override {
+    size_t pos;
+    size_t len = size_t(count) * sector_size;
+    if (!locate(sector, 0, len, pos)) return false;
+    size_t end = pos + len;
+    while (pos < end) {
+      size_t n = end - pos;
+      uint8_t* ptr = storage.window(pos, n);
+      if (ptr == nullptr) return false;
+      memset(ptr, 0xFF, n);
+      pos += n;
+    }
+    return true;
+  }
+
+ protected:
+  Storage storage;
+  size_t sector_size;
+  size_t sector_count = 0;
+
+  static constexpr const char* TAG = "RamBlockDevice";
+};
+
+/**
+ * @class FileBlockDevice
+ * @brief Block device which is stored in a file, e.g. as stand-in to compare
+ * with a RamBlockDevice or to test file system images
+ * @tparam File Stream based file type with seek(pos), like fs::File
+ */
+template <typename File>
+class FileBlockDevice : public BlockDevice {
+ public:
+  /**
+   * @brief Constructor
+   * @param file The file, opened for reading and writing
+   * @param sectorSize Size of a sector
+   */
+  FileBlockDevice(File file, size_t sectorSize = 512)
+      : file(file), sector_size(sectorSize) {}
+
+  /**
+   * @brief Define the size of the device; the file is extended with zeros
+   * if it is too short
+   * @param sectorCount Number of sectors
+   * @return true if the file has the required size
+   */
+  bool begin(size_t sectorCount) {
+    if (sector_size == 0) return false;
+    size_t required = sectorCount * sector_size;
+    uint8_t zeros[64] = {0};
+    if (!file.seek(file.size())) return false;
+    for (size_t pos = file.size(); pos < required;) {
+      size_t n = std::min(required - pos, sizeof(zeros));
+      if (file.write(zeros, n) != n) return false;
+      pos += n;
+    }
+    sector_count = sectorCount;
+    return true;
+  }
+
+  size_t sectorSize() const override { return sector_size; }
+
+  size_t sectorCount() const override { return sector_count; }
+
+  bool read(uint32_t sector, size_t offset, uint8_t* buffer,
+            size_t len) override {
+    size_t pos;
+    if (!locate(sector, offset, len, pos) || !file.seek(pos)) return false;
+    return file.readBytes(reinterpret_cast<char*>(buffer), len) == len;
+  }
+
+  bool program(uint32_t sector, size_t offset, const uint8_t* buffer,
+               size_t len) override {
+    size_t pos;
+    if (!locate(sector, offset, len, pos) || !file.seek(pos)) return false;
+    return file.write(buffer, len) == len;
+  }
+
+  bool erase(uint32_t sector, uint32_t count = 1) override {
+    size_t pos;
+    size_t len = size_t(count) * sector_size;
+    if (!locate(sector, 0, len, pos) || !file.seek(pos)) return false;
+    uint8_t ones[64];
+    memset(ones, 0xFF, sizeof(ones));
+    for (size_t done = 0; done < len;) {
+      size_t n = std::min(len - done, sizeof(ones));
+      if (file.write(ones, n) != n) return false;
+      done += n;
+    }
+    return true;
+  }
+
+  bool sync() override {
+    file.flush();
+    return true;
+  }
+
+ protected:
+  File file;
+  size_t sector_size;
+  size_t sector_count = 0;
+};
+
+/**
+ * @brief RAM disk in PSRAM
+ */
+using RamBlockDevicePSRAM = RamBlockDevice<PagedVectorPSRAM>;
+
+/**
+ * @brief RAM disk in HIMEM with sectors inside of one 32K window
+ */
+using RamBlockDeviceHIMEM = RamBlockDevice<PagedVectorHIMEM>;
+
+}  // namespace esp32_psram
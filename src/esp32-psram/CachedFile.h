@@ -0,0 +1,437 @@
+#pragma once
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "InMemoryFile.h"
+
+namespace esp32_psram {
+
+/**
+ * @struct CacheStats
+ * @brief Statistics of a CachedFile
+ */
+struct CacheStats {
+  /// Number of bytes written to the target
+  size_t bytesWritten = 0;
+  /// Number of bytes rejected by write() or not accepted by the target
+  size_t bytesDropped = 0;
+  /// Number of write() calls to the target
+  uint32_t chunks = 0;
+  /// Duration of the last write to the target in microseconds
+  uint32_t lastLatencyUs = 0;
+  /// Longest write to the target in microseconds
+  uint32_t maxLatencyUs = 0;
+  /// Sum of the durations of all writes to the target in microseconds
+  uint64_t totalLatencyUs = 0;
+  /// Number of write() calls which had to wait for free buffer space
+  uint32_t stalls = 0;
+  /// Time write() waited for free buffer space in microseconds
+  uint64_t stallUs = 0;
+
+  /**
+   * @brief Get the average duration of a write to the target
+   * @return Microseconds (0 if nothing was written)
+   */
+  uint32_t averageLatencyUs() const {
+    return chunks == 0 ? 0 : (uint32_t)(totalLatencyUs / chunks);
+  }
+};
+
+/**
+ * @class CachedFile
+ * @brief Write-behind cache which decouples a producer from a slow target,
+ * e.g. a file on a SD card
+ * @tparam VectorType Storage of the buffers (PagedVectorPSRAM or
+ * PagedVectorHIMEM)
+ *
+ * write() only copies the data into an InMemoryFile in PSRAM or HIMEM. A
+ * background task writes it to the target in chunks of chunkSize bytes which
+ * start at multiples of chunkSize of the target position, so a SD card sees
+ * whole, aligned clusters. Two buffers are used: while the task writes the
+ * content of one buffer, new data is written into the other one.
+ *
+ * An incomplete chunk is written when flush() is called, after the flush
+ * interval or by end(). The chunks are copied through a buffer in internal
+ * RAM, which SD drivers need for DMA anyway.
+ *
+ * Backpressure: write() accepts at most limit bytes which are not written
+ * to the target yet. If the buffers are full, write() waits up to the write
+ * timeout for the task and then returns the number of bytes which fit; the
+ * rest is counted as dropped. A timeout of 0 never blocks the producer.
+ *
+ * write() and flush() can be called by several tasks, begin() and end() must
+ * not be called concurrently with them.
+ */
+template <typename VectorType>
+class CachedFile : public Print {
+ public:
+  /// Timeout which waits until space is available
+  static constexpr uint32_t kWaitForever = UINT32_MAX;
+
+  /**
+   * @brief Constructor
+   * @param target Destination of the data, e.g. a fs::File
+   * @param limit Maximum number of buffered bytes
+   * @param chunkSize Size of the writes to the target
+   */
+  CachedFile(Print& target, size_t limit = 64 * 1024, size_t chunkSize = 4096)
+      : target(target), limit(limit), chunk_size(chunkSize) {}
+
+  CachedFile(const CachedFile&) = delete;
+  CachedFile& operator=(const CachedFile&) = delete;
+
+  ~CachedFile() {
+    end();
+    if (lock != nullptr) vSemaphoreDelete(lock);
+    if (drained != nullptr) vSemaphoreDelete(drained);
+  }
+
+  /**
+   * @brief Define how long write() waits for free space
+   * @param timeoutMs Milliseconds, 0 to drop data at once, kWaitForever to
+   * never drop data
+   */
+  void setWriteTimeout(uint32_t timeoutMs) { write_timeout_ms = timeoutMs; }
+
+  /**
+   * @brief Define after which time incomplete chunks are written (call
+   * before begin())
+   * @param intervalMs Milliseconds, 0 to write them only on flush()
+   */
+  void setFlushInterval(uint32_t intervalMs) { flush_interval_ms = intervalMs; }
+
+  /**
+   * @brief Define the position of the target at which the next byte is
+   * written, which is used to align the chunks; e.g. the size of a file which
+   * was opened for appending (call before begin())
+   * @param pos The position
+   */
+  void setPosition(size_t pos) { position = pos; }
+
+  /**
+   * @brief Start the background task
+   * @param stackSize Stack size of the task in bytes
+   * @param priority Priority of the task
+   * @param core Core of the task (tskNO_AFFINITY for any)
+   * @return true if the task was started
+   */
+  bool begin(uint32_t stackSize = 4096, UBaseType_t priority = 1,
+             BaseType_t core = tskNO_AFFINITY) {
+    if (task != nullptr) return true;
+    if (chunk_size == 0 || limit < chunk_size) {
+      ESP_LOGE(TAG, "limit %u must be at least the chunk size %u",
+               (unsigned)limit, (unsigned)chunk_size);
+      return false;
+    }
+    if (lock == nullptr) lock = xSemaphoreCreateMutex();
+    if (drained == nullptr) drained = xSemaphoreCreateBinary();
+    if (lock == nullptr || drained == nullptr) return false;
+    chunk_buffer.resize(chunk_size);
+    for (auto& buffer : buffers) buffer.open(FileMode::READ_WRITE);
+    stop = false;
+    stopped.store(false);
+    if (xTaskCreatePinnedToCore(flushTask, "CachedFile", stackSize, this,
+                                priority, &task, core) != pdPASS) {
+      ESP_LOGE(TAG, "could not start the task");
+      task = nullptr;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Write all buffered data to the target and stop the task
+   */
+  void end() {
+    if (task == nullptr) return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    stop = true;
+    xSemaphoreGive(lock);
+    xTaskNotifyGive(task);
+    while (!stopped.load(std::memory_order_acquire)) delay(1);
+    task = nullptr;
+  }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  /**
+   * @brief Copy data into the buffer
+   * @param data The data
+   * @param len Number of bytes
+   * @return Number of bytes accepted, less than len if the buffer stayed
+   * full for the write timeout
+   */
+  size_t write(const uint8_t* data, size_t len) override {
+    if (task == nullptr) {
+      ESP_LOGE(TAG, "write failed: not started");
+      return 0;
+    }
+    uint32_t start = millis();
+    uint32_t stallStart = 0;
+    bool stalled = false;
+    size_t done = 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    while (done < len) {
+      size_t used = pendingLocked();
+      size_t room = used < limit ? limit - used : 0;
+      if (room == 0) {
+        uint32_t waited = millis() - start;
+        if (waited >= write_timeout_ms) break;
+        if (!stalled) {
+          stalled = true;
+          stallStart = micros();
+        }
+        xSemaphoreGive(lock);
+        xTaskNotifyGive(task);
+        uint32_t wait = std::min<uint32_t>(write_timeout_ms - waited, kPollMs);
+        xSemaphoreTake(drained, pdMS_TO_TICKS(wait));
+        xSemaphoreTake(lock, portMAX_DELAY);
+        continue;
+      }
+      size_t n = front().write(data + done, std::min(room, len - done));
+      if (n == 0) break;
+      done += n;
+    }
+    if (stalled) {
+      statistics.stalls++;
+      statistics.stallUs += micros() - stallStart;
+    }
+    statistics.bytesDropped += len - done;
+    bool chunkReady = front().size() >= chunk_size;
+    xSemaphoreGive(lock);
+    if (chunkReady) xTaskNotifyGive(task);
+    return done;
+  }
+
+  /**
+   * @brief Get the free buffer space
+   * @return Number of bytes which can be written without waiting
+   */
+  int availableForWrite() override {
+    if (lock == nullptr) return 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t used = pendingLocked();
+    xSemaphoreGive(lock);
+    return used < limit ? limit - used : 0;
+  }
+
+  /**
+   * @brief Write all data which was written so far to the target and flush
+   * the target
+   */
+  void flush() override { sync(); }
+
+  /**
+   * @brief Write all data which was written so far to the target and flush
+   * the target
+   * @param timeoutMs Maximum time to wait in milliseconds
+   * @return true if the data was written within the timeout
+   */
+  bool sync(uint32_t timeoutMs = kWaitForever) {
+    if (task == nullptr) return pending() == 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    uint32_t ticket = ++sync_requested;
+    xSemaphoreGive(lock);
+    xTaskNotifyGive(task);
+    uint32_t start = millis();
+    while (true) {
+      xSemaphoreTake(lock, portMAX_DELAY);
+      bool done = (int32_t)(sync_done - ticket) >= 0;
+      xSemaphoreGive(lock);
+      if (done) return true;
+      uint32_t waited = millis() - start;
+      if (waited >= timeoutMs) return false;
+      uint32_t wait = std::min<uint32_t>(timeoutMs - waited, kPollMs);
+      xSemaphoreTake(drained, pdMS_TO_TICKS(wait));
+    }
+  }
+
+  /**
+   * @brief Get the number of bytes which are not written to the target yet
+   * @return Number of bytes
+   */
+  size_t pending() {
+    if (lock == nullptr) return 0;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    size_t result = pendingLocked();
+    xSemaphoreGive(lock);
+    return result;
+  }
+
+  /**
+   * @brief Get the statistics
+   * @return Copy of the statistics
+   */
+  CacheStats stats() {
+    if (lock == nullptr) return statistics;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    CacheStats result = statistics;
+    xSemaphoreGive(lock);
+    return result;
+  }
+
+  /**
+   * @brief Reset the statistics
+   */
+  void resetStats() {
+    if (lock != nullptr) xSemaphoreTake(lock, portMAX_DELAY);
+    statistics = CacheStats();
+    if (lock != nullptr) xSemaphoreGive(lock);
+  }
+
+ protected:
+  using FileType = InMemoryFile<VectorType>;
+
+  Print& target;
+  FileType buffers[2];
+  int front_index = 0;  // buffer which receives write()
+  std::vector<uint8_t> chunk_buffer;  // internal RAM for the target writes
+  size_t limit;
+  size_t chunk_size;
+  uint32_t write_timeout_ms = kWaitForever;
+  uint32_t flush_interval_ms = 1000;
+  size_t position = 0;  // position of the target
+  size_t in_flight = 0;  // bytes which the task is writing
+  uint32_t sync_requested = 0;
+  uint32_t sync_done = 0;
+  bool stop = false;
+  CacheStats statistics;
+  TaskHandle_t task = nullptr;
+  SemaphoreHandle_t lock = nullptr;  // protects all fields above
+  SemaphoreHandle_t drained = nullptr;  // given when buffer space was freed
+  std::atomic<bool> stopped{false};  // set by the task when it ends
+
+  static constexpr uint32_t kPollMs = 10;
+  static constexpr const char* TAG = "CachedFile";
+
+  FileType& front() { return buffers[front_index]; }
+
+  size_t pendingLocked() { return front().size() + in_flight; }
+
+  static void flushTask(void* arg) {
+    static_cast<CachedFile*>(arg)->run();
+    vTaskDelete(nullptr);
+  }
+
+  /**
+   * @brief Main loop of the background task
+   */
+  void run() {
+    TickType_t wait = flush_interval_ms > 0 ? pdMS_TO_TICKS(flush_interval_ms)
+                                            : portMAX_DELAY;
+    uint32_t lastFlush = millis();
+    bool dirty = false;  // data was written since the last target flush
+    while (true) {
+      ulTaskNotifyTake(pdTRUE, wait);
+      xSemaphoreTake(lock, portMAX_DELAY);
+      bool stopping = stop;
+      uint32_t requested = sync_requested;
+      xSemaphoreGive(lock);
+
+      bool force = stopping || requested != sync_done ||
+                   (flush_interval_ms > 0 &&
+                    millis() - lastFlush >= flush_interval_ms);
+      if (drain(force) > 0) dirty = true;
+      // continue with the complete chunks which were written meanwhile
+      while (drain(false) > 0) dirty = true;
+      if (force) {
+        if (dirty) target.flush();
+        dirty = false;
+        lastFlush = millis();
+      }
+
+      xSemaphoreTake(lock, portMAX_DELAY);
+      if (force) sync_done = requested;
+      xSemaphoreGive(lock);
+      xSemaphoreGive(drained);
+      if (stopping) {
+        // last access: end() may destroy the object afterwards
+        stopped.store(true, std::memory_order_release);
+        return;
+      }
+    }
+  }
+
+  /**
+   * @brief Swap the buffers and write the full one to the target
+   * @param all true to write an incomplete chunk as well; otherwise it is
+   * moved into the new front buffer
+   * @return Number of bytes taken from the buffer
+   */
+  size_t drain(bool all) {
+    xSemaphoreTake(lock, portMAX_DELAY);
+    FileType& back = front();
+    size_t size = back.size();
+    size_t lead = chunk_size - position % chunk_size;  // to the next boundary
+    size_t take = size;
+    if (!all) take = size < lead ? 0 : size - (size - lead) % chunk_size;
+    if (take == 0) {
+      xSemaphoreGive(lock);
+      return 0;
+    }
+    front_index ^= 1;
+    if (take < size) {
+      // the new front buffer is empty: continue it with the incomplete chunk
+      size_t tail = size - take;
+      back.pread(chunk_buffer.data(), tail, take);
+      back.seek(take);
+      back.truncate();
+      front().write(chunk_buffer.data(), tail);
+    }
+    in_flight = take;
+    xSemaphoreGive(lock);
+
+    // write without lock, so that write() can continue with the front buffer
+    size_t done = 0;
+    while (done < take) {
+      size_t n =
+          std::min(take - done, chunk_size - (position + done) % chunk_size);
+      back.pread(chunk_buffer.data(), n, done);
+      uint32_t start = micros();
+      size_t written = target.write(chunk_buffer.data(), n);
+      uint32_t latency = micros() - start;
+      xSemaphoreTake(lock, portMAX_DELAY);
+      statistics.chunks++;
+      statistics.bytesWritten += written;
+      statistics.lastLatencyUs = latency;
+      statistics.maxLatencyUs = std::max(statistics.maxLatencyUs, latency);
+      statistics.totalLatencyUs += latency;
+      xSemaphoreGive(lock);
+      done += written;
+      if (written < n) {
+        ESP_LOGE(TAG, "target accepted only %u of %u bytes", (unsigned)written,
+                 (unsigned)n);
+        break;
+      }
+    }
+    back.seek(0);
+    back.truncate();
+
+    xSemaphoreTake(lock, portMAX_DELAY);
+    statistics.bytesDropped += take - done;
+    position += done;
+    in_flight = 0;
+    xSemaphoreGive(lock);
+    xSemaphoreGive(drained);
+    return take;
+  }
+};
+
+/**
+ * @brief Write-behind cache with buffers in PSRAM
+ */
+using CachedFilePSRAM = CachedFile<PagedVectorPSRAM>;
+
+/**
+ * @brief Write-behind cache with buffers in HIMEM
+ */
+using CachedFileHIMEM = CachedFile<PagedVectorHIMEM>;
+
+}  // namespace esp32_psram
@@ -0,0 +1,416 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "BinaryFormat.h"
+#include "InMemoryFile.h"
+#include "LZ4.h"
+#include "VectorPSRAM.h"
+
+namespace esp32_psram {
+
+/**
+ * @brief File header of a CompressedFile
+ */
+namespace compressedfile {
+constexpr uint8_t kMagic[4] = {'L', 'Z', '4', 'B'};
+constexpr size_t kHeaderSize = 8;
+}  // namespace compressedfile
+
+/**
+ * @class CompressedFile
+ * @brief File which compresses its content block by block, e.g. for text
+ * logs and JSON in PSRAM or HIMEM
+ * @tparam FileType The file which stores the compressed blocks (FilePSRAM or
+ * FileHIMEM), so compressed files are part of the file system
+ *
+ * The file starts with a header of 8 bytes: the magic "LZ4B" and the block
+ * size (4 bytes, little endian), so a file is always read with the block
+ * size it was written with. The written data is collected in a block
+ * buffer. Each full block is compressed with LZ4 and appended to the file
+ * with a header of 8 bytes: the size of the data (4 bytes) and the stored
+ * size (4 bytes, the highest bit is set if the block did not compress and is
+ * stored as is). A block
+ * table in PSRAM keeps the position of each block, so a read at any position
+ * decompresses only one block. The most recently read blocks are kept
+ * decompressed in a small cache, so sequential reads decompress each block
+ * once.
+ *
+ * The data can be appended but not overwritten. The last incomplete block
+ * stays uncompressed in the block buffer until close(); it can be read
+ * before. Opening with FileMode::APPEND continues the last block.
+ *
+ * The block buffer and the cache use the default heap, so they are in
+ * internal RAM if it has space. A handle is meant to be used by one task.
+ */
+template <typename FileType>
+class CompressedFile : public Stream {
+ public:
+  /**
+   * @brief Constructor
+   * @param blockSize Size of the uncompressed blocks of new files (e.g. 4K to
+   * 32K, at most 64K); existing files keep the block size which is stored
+   * in them
+   * @param cacheBlocks Number of decompressed blocks which are cached
+   */
+  CompressedFile(size_t blockSize = 16 * 1024, size_t cacheBlocks = 2)
+      : new_block_size(blockSize),
+        block_size(blockSize),
+        cache(std::max<size_t>(cacheBlocks, 1)) {}
+
+  CompressedFile(const CompressedFile&) = delete;
+  CompressedFile& operator=(const CompressedFile&) = delete;
+
+  ~CompressedFile() { close(); }
+
+  /**
+   * @brief Open a compressed file
+   * @param storage The file with the compressed blocks as returned by
+   * PSRAM.open() or HIMEM.open()
+   * @param mode FileMode::READ to read, FileMode::WRITE to start with an
+   * empty file, FileMode::APPEND or FileMode::READ_WRITE to continue it (the
+   * position is at the end; with READ_WRITE seek() to read)
+   * @return true if successful
+   */
+  bool open(FileType storage, FileMode mode) {
+    close();
+    file = storage;
+    if (!file) return false;
+    if (mode == FileMode::WRITE) file.open(FileMode::WRITE);
+    file.open(mode == FileMode::READ ? FileMode::READ : FileMode::READ_WRITE);
+    blocks.clear();
+    block_bytes = 0;
+    block_buffer.clear();
+    for (auto& slot : cache) slot.block = SIZE_MAX;
+    if (!readFileHeader(mode) || !readBlockTable()) return false;
+
+    // continue the last block if it is incomplete
+    if (mode != FileMode::READ && block_bytes % block_size != 0) {
+      size_t len;
+      const uint8_t* data = blockData(blocks.size() - 1, len);
+      if (data == nullptr) return false;
+      block_buffer.assign(data, data + len);
+      file.seek(blocks.back());
+      file.truncate();
+      blocks.pop_back();
+      block_bytes -= len;
+      for (auto& slot : cache) slot.block = SIZE_MAX;
+    }
+    this->mode = mode;
+    // data can only be appended: writing modes start at the end
+    position_ = mode == FileMode::READ ? 0 : size();
+    open_ = true;
+    return true;
+  }
+
+  /**
+   * @brief Compress the last block and close the file
+   */
+  void close() {
+    if (!open_) return;
+    if (mode != FileMode::READ && !block_buffer.empty()) storeBlock();
+    file.close();
+    open_ = false;
+  }
+
+  /**
+   * @brief Check if the file is open
+   */
+  bool isOpen() const { return open_; }
+
+  operator bool() const { return open_; }
+
+  /**
+   * @brief Get the size of the uncompressed content
+   * @return Size in bytes
+   */
+  size_t size() const { return block_bytes + block_buffer.size(); }
+
+  /**
+   * @brief Get the size of the uncompressed blocks of the open file
+   */
+  size_t blockSize() const { return block_size; }
+
+  /**
+   * @brief Get the size of the compressed file
+   * @return Size in bytes
+   */
+  size_t storedSize() const { return file.size(); }
+
+  /**
+   * @brief Get the current position in the uncompressed content
+   */
+  size_t position() const { return position_; }
+
+  /**
+   * @brief Move to a position in the uncompressed content
+   * @param pos The new position
+   * @return true if the position is valid
+   */
+  bool seek(size_t pos) {
+    if (!open_ || pos > size()) return false;
+    position_ = pos;
+    return true;
+  }
+
+  int available() override {
+    if (!open_) return 0;
+    return std::min<size_t>(size() - position_, INT32_MAX);
+  }
+
+  int read() override {
+    uint8_t value;
+    return readBytes(reinterpret_cast<char*>(&value), 1) == 1 ? value : -1;
+  }
+
+  int peek() override {
+    int value = read();
+    if (value >= 0) position_--;
+    return value;
+  }
+
+  /**
+   * @brief Read from the current position: the data is decompressed or
+   * copied from the cache
+   * @param buffer Destination buffer
+   * @param len Number of bytes
+   * @return Number of bytes read
+   */
+  size_t readBytes(char* buffer, size_t len) override {
+    if (!open_) return 0;
+    size_t done = 0;
+    while (done < len && position_ < size()) {
+      size_t offset = position_ % block_size;
+      size_t available;
+      const uint8_t* data = blockData(position_ / block_size, available);
+      if (data == nullptr || available <= offset) break;
+      size_t n = std::min(len - done, available - offset);
+      memcpy(buffer + done, data + offset, n);
+      done += n;
+      position_ += n;
+    }
+    return done;
+  }
+
+  size_t write(uint8_t b) override { return write(&b, 1); }
+
+  /**
+   * @brief Append data; full blocks are compressed
+   * @param data The data
+   * @param len Number of bytes
+   * @return Number of bytes written
+   */
+  size_t write(const uint8_t* data, size_t len) override {
+    if (!open_ || mode == FileMode::READ) {
+      ESP_LOGE(TAG, "write failed: file not open for writing");
+      return 0;
+    }
+    if (position_ != size()) {
+      ESP_LOGE(TAG, "write failed: data can only be appended");
+      return 0;
+    }
+    size_t done = 0;
+    while (done < len) {
+      if (block_buffer.size() == block_size && !storeBlock()) break;
+      size_t n = std::min(len - done, block_size - block_buffer.size());
+      block_buffer.insert(block_buffer.end(), data + done, data + done + n);
+      done += n;
+    }
+    position_ = size();
+    return done;
+  }
+
+  /**
+   * @brief No-op: the incomplete last block is compressed by close()
+   */
+  void flush() override {}
+
+ protected:
+  /// Decompressed block in the cache
+  struct CacheSlot {
+    size_t block = SIZE_MAX;
+    uint32_t used = 0;
+    std::vector<uint8_t> data;
+  };
+
+  static constexpr size_t kHeaderSize = 8;
+  static constexpr uint32_t kStoredFlag = 0x80000000u;
+  static constexpr const char* TAG = "CompressedFile";
+
+  FileType file;
+  size_t new_block_size;  // block size of new files
+  size_t block_size;  // block size of the open file
+  VectorPSRAM<size_t> blocks;  // position of each compressed block
+  size_t block_bytes = 0;  // uncompressed size of the compressed blocks
+  std::vector<uint8_t> block_buffer;  // last, incomplete block
+  std::vector<uint8_t> compressed;  // stored form of one block
+  std::vector<uint16_t> hash_table;
+  std::vector<CacheSlot> cache;
+  uint32_t use_counter = 0;
+  size_t position_ = 0;
+  bool open_ = false;
+  FileMode mode = FileMode::READ;
+
+  /**
+   * @brief Determine the block size from the file header; an empty file which
+   * is opened for writing gets a header with the block size for new files
+   * @return false if the file is invalid
+   */
+  bool readFileHeader(FileMode mode) {
+    uint8_t header[compressedfile::kHeaderSize];
+    if (file.size() == 0) {
+      block_size = new_block_size;
+      memcpy(header, compressedfile::kMagic, sizeof(compressedfile::kMagic));
+      binary::storeNumber(header + 4, block_size, 4);
+      if (!isValidBlockSize()) return false;
+      return mode == FileMode::READ ||
+             file.pwrite(header, sizeof(header), 0) == sizeof(header);
+    }
+    if (file.pread(header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header, compressedfile::kMagic,
+               sizeof(compressedfile::kMagic)) != 0) {
+      ESP_LOGE(TAG, "not a compressed file");
+      return false;
+    }
+    block_size = binary::loadNumber(header + 4, 4);
+    return isValidBlockSize();
+  }
+
+  bool isValidBlockSize() const {
+    if (block_size > 0 && block_size <= lz4::kMaxBlockSize) return true;
+    ESP_LOGE(TAG, "invalid block size %u", (unsigned)block_size);
+    return false;
+  }
+
+  /**
+   * @brief Collect the positions of the blocks of the file
+   * @return false if the file is invalid
+   */
+  bool readBlockTable() {
+    size_t stored = file.size();
+    if (stored == 0) return true;
+    size_t pos = compressedfile::kHeaderSize;
+    size_t last = block_size;
+    while (pos < stored) {
+      uint8_t header[kHeaderSize];
+      if (stored - pos < kHeaderSize ||
+          file.pread(header, kHeaderSize, pos) != kHeaderSize) {
+        break;
+      }
+      size_t len = binary::loadNumber(header, 4);
+      size_t storedLen = binary::loadNumber(header + 4, 4) & ~kStoredFlag;
+      // only the last block can be incomplete
+      if (last < block_size || len == 0 || len > block_size ||
+          storedLen > stored - pos - kHeaderSize) {
+        break;
+      }
+      blocks.push_back(pos);
+      block_bytes += len;
+      last = len;
+      pos += kHeaderSize + storedLen;
+    }
+    if (pos != stored) {
+      ESP_LOGE(TAG, "invalid block at %u", (unsigned)pos);
+      blocks.clear();
+      block_bytes = 0;
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Compress the block buffer and append it to the file
+   */
+  bool storeBlock() {
+    size_t len = block_buffer.size();
+    compressed.resize(kHeaderSize + lz4::compressBound(block_size));
+    hash_table.resize(lz4::kHashTableSize);
+    size_t n =
+        lz4::compress(block_buffer.data(), len, compressed.data() + kHeaderSize,
+                      compressed.size() - kHeaderSize, hash_table.data());
+    uint32_t storedLen = n;
+    if (n == 0 || n >= len) {
+      memcpy(compressed.data() + kHeaderSize, block_buffer.data(), len);
+      n = len;
+      storedLen = len | kStoredFlag;
+    }
+    binary::storeNumber(compressed.data(), len, 4);
+    binary::storeNumber(compressed.data() + 4, storedLen, 4);
+    size_t pos = file.size();
+    if (file.pwrite(compressed.data(), kHeaderSize + n, pos) !=
+        kHeaderSize + n) {
+      ESP_LOGE(TAG, "could not store block %u", (unsigned)blocks.size());
+      file.seek(pos);
+      file.truncate();
+      return false;
+    }
+    blocks.push_back(pos);
+    block_bytes += len;
+    block_buffer.clear();
+    return true;
+  }
+
+  /**
+   * @brief Get the uncompressed data of a block
+   * @param index Index of the block, blocks.size() for the block buffer
+   * @param len Out: size of the data
+   * @return The data, nullptr if the block is invalid
+   */
+  const uint8_t* blockData(size_t index, size_t& len) {
+    if (index == blocks.size()) {
+      len = block_buffer.size();
+      return block_buffer.data();
+    }
+    CacheSlot* victim = &cache[0];
+    for (auto& slot : cache) {
+      if (slot.block == index) {
+        slot.used = ++use_counter;
+        len = slot.data.size();
+        return slot.data.data();
+      }
+      if (slot.used < victim->used) victim = &slot;
+    }
+
+    // cache miss: decompress into the least recently used slot
+    size_t pos = blocks[index];
+    uint8_t header[kHeaderSize];
+    if (file.pread(header, kHeaderSize, pos) != kHeaderSize) return nullptr;
+    len = binary::loadNumber(header, 4);
+    uint32_t storedLen = binary::loadNumber(header + 4, 4);
+    size_t n = storedLen & ~kStoredFlag;
+    victim->block = SIZE_MAX;
+    victim->data.resize(len);
+    if (storedLen & kStoredFlag) {
+      if (file.pread(victim->data.data(), len, pos + kHeaderSize) != len) {
+        return nullptr;
+      }
+    } else {
+      compressed.resize(std::max(compressed.size(), n));
+      if (file.pread(compressed.data(), n, pos + kHeaderSize) != n ||
+          lz4::decompress(compressed.data(), n, victim->data.data(), len) !=
+              len) {
+        ESP_LOGE(TAG, "invalid block %u", (unsigned)index);
+        return nullptr;
+      }
+    }
+    victim->block = index;
+    victim->used = ++use_counter;
+    return victim->data.data();
+  }
+};
+
+/**
+ * @brief Compressed file in PSRAM
+ */
+using CompressedFilePSRAM = CompressedFile<FilePSRAM>;
+
+/**
+ * @brief Compressed file in HIMEM
+ */
+using CompressedFileHIMEM = CompressedFile<FileHIMEM>;
+
+}  // namespace esp32_psram
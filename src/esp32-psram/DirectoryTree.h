@@ -0,0 +1,480 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "AllocatorPSRAM.h"
+
+namespace esp32_psram {
+
+/**
+ * @class DirectoryTree
+ * @brief Hierarchical directory structure with a hash index per directory
+ * @tparam Body The type of the file content
+ *
+ * Each directory keeps its entries in a linked list in insertion order
+ * together with a hash index from the name hash to the entry, so looking up
+ * a path costs O(1) expected time per path component, independent of the
+ * number of files, and stepping to the next entry of a directory is O(1).
+ * Lookups work directly on the path and never allocate memory. Entries,
+ * names and indexes are allocated in PSRAM.
+ *
+ * Entries are reference counted, so file handles can keep an entry as a
+ * cursor. A removed entry stays valid as long as it is referenced: it
+ * remembers its full path and the entry which followed it, so iterating a
+ * directory continues correctly when the current entry is removed.
+ *
+ * Paths always start with '/'; repeated and trailing '/' are ignored and
+ * "." and ".." are resolved lexically ("/a/../b" is "/b", even if "/a" does
+ * not exist).
+ *
+ * The tree is not synchronized, the owner needs to lock it. This includes
+ * reading the links and the path of an entry.
+ */
+template <typename Body>
+class DirectoryTree {
+ public:
+  using Name = std::basic_string<char, std::char_traits<char>,
+                                 AllocatorPSRAM<char>>;
+  using BodyPtr = std::shared_ptr<Body>;
+
+  struct Entry;
+  using EntryPtr = std::shared_ptr<Entry>;
+
+  /**
+   * @brief The index is keyed by the (already mixed) FNV-1a name hash
+   */
+  struct IdentityHash {
+    size_t operator()(uint32_t hash) const { return hash; }
+  };
+  using EntryIndex =
+      std::unordered_multimap<uint32_t, Entry*, IdentityHash,
+                              std::equal_to<uint32_t>,
+                              AllocatorPSRAM<std::pair<const uint32_t, Entry*>>>;
+
+  /**
+   * @struct Entry
+   * @brief A file or directory
+   */
+  struct Entry : public std::enable_shared_from_this<Entry> {
+    /// Name of the entry in its directory (the full path once removed)
+    Name name;
+    /// Content of a file, nullptr for directories
+    BodyPtr body;
+    /// The directory which contains the entry (nullptr for the root and
+    /// removed entries)
+    Entry* parent = nullptr;
+    /// The following entry of the same directory; a removed entry keeps the
+    /// entry which followed it at the time of the removal
+    EntryPtr next;
+    Entry* prev = nullptr;
+    /// The entries of a directory in insertion order
+    EntryPtr firstChild;
+    Entry* lastChild = nullptr;
+    /// Hash index of the children by name
+    EntryIndex index;
+    bool removed = false;
+
+    Entry() = default;
+    Entry(const Entry&) = delete;
+    Entry& operator=(const Entry&) = delete;
+
+    ~Entry() {
+      // release chains of removed entries iteratively, not recursively
+      EntryPtr current = std::move(next);
+      while (current && current.use_count() == 1) {
+        // we are the last owner: see all changes of the previous owners
+        std::atomic_thread_fence(std::memory_order_acquire);
+        EntryPtr following = std::move(current->next);
+        current = std::move(following);
+      }
+    }
+
+    bool isDirectory() const { return body == nullptr; }
+
+    /**
+     * @brief Check if the entry was removed from the tree
+     * @return true if removed
+     */
+    bool isRemoved() const { return removed; }
+
+    /**
+     * @brief Determine the full path of the entry
+     * @return Path starting with '/'
+     */
+    String path() const {
+      String result;
+      appendPath(result);
+      return result.length() > 0 ? result : String("/");
+    }
+
+   protected:
+    void appendPath(String& out) const {
+      if (parent == nullptr) {
+        // the root contributes nothing, a removed entry its full path
+        if (removed) out.concat(name.data(), name.size());
+        return;
+      }
+      parent->appendPath(out);
+      out += '/';
+      out.concat(name.data(), name.size());
+    }
+  };
+
+  DirectoryTree() = default;
+  DirectoryTree(const DirectoryTree&) = delete;
+  DirectoryTree& operator=(const DirectoryTree&) = delete;
+  ~DirectoryTree() {
+    while (root_.firstChild) remove(root_.firstChild.get(), true);
+  }
+
+  /**
+   * @brief Get the root directory
+   * @return The root
+   */
+  Entry* root() { return &root_; }
+
+  /**
+   * @brief Get a shared reference to an entry, e.g. to keep it in a handle
+   * @param entry The entry
+   * @return The reference (the root is owned by the tree and not counted)
+   */
+  EntryPtr share(Entry* entry) {
+    if (entry == nullptr) return EntryPtr();
+    if (entry == &root_) return EntryPtr(EntryPtr(), &root_);
+    return entry->shared_from_this();
+  }
+
+  /**
+   * @brief Look up a file or directory
+   * @param path The path
+   * @return The entry or nullptr if it does not exist
+   */
+  Entry* find(const char* path) {
+    Entry* current = &root_;
+    bool found = forEachResolved(path, [&](const char* name, size_t len) {
+      current = child(current, name, len);
+      return current != nullptr;
+    });
+    return found ? current : nullptr;
+  }
+
+  /**
+   * @brief Create a directory together with the missing parent directories
+   * @param path The path
+   * @return The directory or nullptr if a component of the path is a file
+   */
+  Entry* makeDirectory(const char* path) { return create(path, false); }
+
+  /**
+   * @brief Find or create a file; missing parent directories are created
+   * @param path The path
+   * @return The file or nullptr if the path or a parent is not a file or
+   * directory as expected
+   */
+  Entry* makeFile(const char* path) { return create(path, true); }
+
+  /**
+   * @brief Remove a file or directory
+   *
+   * Entries which are still referenced by a handle keep their full path and
+   * are released with the last reference.
+   * @param entry The entry (not the root)
+   * @param recursive true to remove a directory which is not empty
+   * @return true if removed
+   */
+  bool remove(Entry* entry, bool recursive = false) {
+    if (entry == nullptr || entry == &root_ || entry->removed) return false;
+    if (!recursive && entry->firstChild) return false;
+
+    // unlink from the directory: our reference keeps it alive until the end
+    Entry* parent = entry->parent;
+    auto range = parent->index.equal_range(hash(entry->name.data(),
+                                                entry->name.size()));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second == entry) {
+        parent->index.erase(it);
+        break;
+      }
+    }
+    EntryPtr self = entry->prev != nullptr ? std::move(entry->prev->next)
+                                           : std::move(parent->firstChild);
+    if (entry->prev != nullptr) {
+      entry->prev->next = entry->next;
+    } else {
+      parent->firstChild = entry->next;
+    }
+    if (entry->next) {
+      entry->next->prev = entry->prev;
+    } else {
+      parent->lastChild = entry->prev;
+    }
+    entry->prev = nullptr;
+
+    // children before parents, so that the paths can still be determined
+    for (Entry* e = deepestFirst(entry); e != nullptr;
+         e = postOrderNext(e, entry)) {
+      if (!e->isDirectory()) file_count--;
+      // besides the tree somebody else keeps a reference
+      if (e->shared_from_this().use_count() > 2) {
+        String path = e->path();
+        e->name.assign(path.c_str(), path.length());
+      }
+    }
+
+    // release the content of removed directories iteratively
+    EntryPtr pending = std::move(entry->firstChild);
+    while (pending) {
+      EntryPtr e = std::move(pending);
+      pending = std::move(e->next);
+      if (e->firstChild) {
+        e->lastChild->next = std::move(pending);
+        pending = std::move(e->firstChild);
+      }
+      detach(e.get());
+    }
+    detach(entry);
+    return true;
+  }
+
+  /**
+   * @brief Get the first entry of a directory
+   * @param dir The directory
+   * @return The first entry or nullptr if the directory is empty
+   */
+  static Entry* first(Entry* dir) {
+    if (dir == nullptr) return nullptr;
+    return dir->firstChild.get();
+  }
+
+  /**
+   * @brief Get the entry which follows an entry in its directory
+   * @param entry The entry, which might have been removed in the meantime
+   * @return The next entry or nullptr if this was the last one
+   */
+  static Entry* next(Entry* entry) {
+    if (entry == nullptr) return nullptr;
+    Entry* result = entry->next.get();
+    while (result != nullptr && result->removed) result = result->next.get();
+    return result;
+  }
+
+  /**
+   * @brief Walk through a subtree in pre-order (directories before their
+   * entries)
+   * @param entry The current entry
+   * @param top The directory of the subtree
+   * @return The following entry or nullptr at the end of the subtree
+   */
+  static Entry* walk(Entry* entry, Entry* top) {
+    if (entry == nullptr) return nullptr;
+    if (entry->firstChild) return entry->firstChild.get();
+    for (; entry != nullptr && entry != top; entry = entry->parent) {
+      if (entry->next) return entry->next.get();
+    }
+    return nullptr;
+  }
+
+  /**
+   * @brief Get the number of files in the tree
+   * @return Number of files (without directories)
+   */
+  size_t fileCount() const { return file_count; }
+
+  /**
+   * @brief Exchange all entries with another tree; the roots stay in place
+   * @param other The other tree
+   */
+  void swap(DirectoryTree& other) {
+    std::swap(root_.firstChild, other.root_.firstChild);
+    std::swap(root_.lastChild, other.root_.lastChild);
+    std::swap(root_.index, other.root_.index);
+    std::swap(file_count, other.file_count);
+    for (Entry* e = first(&root_); e != nullptr; e = e->next.get()) {
+      e->parent = &root_;
+    }
+    for (Entry* e = first(&other.root_); e != nullptr; e = e->next.get()) {
+      e->parent = &other.root_;
+    }
+  }
+
+ protected:
+  Entry root_;
+  size_t file_count = 0;
+
+  /**
+   * @brief FNV-1a hash of a name
+   */
+  static uint32_t hash(const char* name, size_t len) {
+    uint32_t result = 2166136261u;
+    for (size_t j = 0; j < len; j++) {
+      result = (result ^ static_cast<uint8_t>(name[j])) * 16777619u;
+    }
+    return result;
+  }
+
+  static bool isParentReference(const char* name, size_t len) {
+    return len == 2 && name[0] == '.' && name[1] == '.';
+  }
+
+  /**
+   * @brief Call the action for each path component ("." and empty
+   * components are skipped)
+   * @return false if the action returned false
+   */
+  template <typename Action>
+  static bool forEachComponent(const char* path, Action action) {
+    if (path == nullptr) return true;
+    const char* pos = path;
+    while (*pos != 0) {
+      while (*pos == '/') pos++;
+      const char* end = pos;
+      while (*end != 0 && *end != '/') end++;
+      size_t len = end - pos;
+      if (len > 0 && !(len == 1 && *pos == '.')) {
+        if (!action(pos, len)) return false;
+      }
+      pos = end;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Call the action for the path components which remain after ".."
+   * was resolved lexically: a component which is followed by a matching ".."
+   * is skipped together with the "..", so it does not need to exist
+   * @return false if the action returned false
+   */
+  template <typename Action>
+  static bool forEachResolved(const char* path, Action action) {
+    size_t skipped = 0;  // skipped components which wait for their ".."
+    return forEachComponent(path, [&](const char* name, size_t len) {
+      if (isParentReference(name, len)) {
+        if (skipped > 0) {
+          skipped--;
+          return true;
+        }
+      } else if (isCancelled(name + len)) {
+        skipped++;
+        return true;
+      }
+      return action(name, len);
+    });
+  }
+
+  /**
+   * @brief Check if a later ".." refers to the parent of a component
+   * @param rest The path after the component
+   */
+  static bool isCancelled(const char* rest) {
+    long depth = 0;
+    bool cancelled = false;
+    forEachComponent(rest, [&](const char* name, size_t len) {
+      depth += isParentReference(name, len) ? -1 : 1;
+      cancelled = depth < 0;
+      return !cancelled;
+    });
+    return cancelled;
+  }
+
+  /**
+   * @brief Look up an entry of a directory; ".." is the parent
+   */
+  Entry* child(Entry* dir, const char* name, size_t len) {
+    if (!dir->isDirectory()) return nullptr;
+    if (isParentReference(name, len)) {
+      return dir->parent != nullptr ? dir->parent : dir;
+    }
+    auto range = dir->index.equal_range(hash(name, len));
+    for (auto it = range.first; it != range.second; ++it) {
+      Entry* entry = it->second;
+      if (entry->name.size() == len &&
+          memcmp(entry->name.data(), name, len) == 0) {
+        return entry;
+      }
+    }
+    return nullptr;
+  }
+
+  Entry* addChild(Entry* dir, const char* name, size_t len) {
+    EntryPtr entry = std::allocate_shared<Entry>(AllocatorPSRAM<Entry>());
+    Entry* result = entry.get();
+    result->name.assign(name, len);
+    result->parent = dir;
+    result->prev = dir->lastChild;
+    if (dir->lastChild != nullptr) {
+      dir->lastChild->next = std::move(entry);
+    } else {
+      dir->firstChild = std::move(entry);
+    }
+    dir->lastChild = result;
+    dir->index.emplace(hash(name, len), result);
+    return result;
+  }
+
+  Entry* create(const char* path, bool file) {
+    // all components except the last one are directories
+    Entry* dir = &root_;
+    const char* name = nullptr;
+    size_t len = 0;
+    bool ok = forEachResolved(path, [&](const char* next, size_t next_len) {
+      if (name != nullptr) {
+        Entry* sub = child(dir, name, len);
+        if (sub == nullptr) sub = addChild(dir, name, len);
+        if (!sub->isDirectory()) return false;
+        dir = sub;
+      }
+      name = next;
+      len = next_len;
+      return true;
+    });
+    if (!ok) return nullptr;
+    if (name == nullptr) return file ? nullptr : &root_;
+
+    Entry* entry = child(dir, name, len);
+    if (entry != nullptr) {
+      return entry->isDirectory() == !file ? entry : nullptr;
+    }
+    entry = addChild(dir, name, len);
+    if (file) {
+      entry->body = std::allocate_shared<Body>(AllocatorPSRAM<Body>());
+      file_count++;
+    }
+    return entry;
+  }
+
+  /**
+   * @brief Mark an unlinked entry as removed and drop its directory content
+   */
+  static void detach(Entry* entry) {
+    entry->parent = nullptr;
+    entry->prev = nullptr;
+    entry->lastChild = nullptr;
+    entry->index.clear();
+    entry->removed = true;
+  }
+
+  static Entry* deepestFirst(Entry* entry) {
+    while (entry->firstChild) entry = entry->firstChild.get();
+    return entry;
+  }
+
+  /**
+   * @brief Post-order successor of an entry in the subtree of top
+   */
+  static Entry* postOrderNext(Entry* entry, Entry* top) {
+    if (entry == top) return nullptr;
+    if (entry->next) return deepestFirst(entry->next.get());
+    return entry->parent;
+  }
+};
+
+}  // namespace esp32_psram
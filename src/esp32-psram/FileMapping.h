@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iterator>
+
+#include "Span.h"
+#include "VectorAccess.h"
+
+namespace esp32_psram {
+
+/**
+ * @class FileMapping
+ * @brief Direct access to a byte range of the storage of an InMemoryFile
+ * @tparam VectorType The storage type of the file
+ * @tparam Byte uint8_t for a writable or const uint8_t for a read-only view
+ *
+ * The range is accessed without copies as a sequence of contiguous chunks:
+ * - VectorPSRAM storage: a single chunk
+ * - PagedVectorPSRAM storage: one chunk per page
+ * - HIMEM storage: one chunk per mapped 32K window
+ *
+ * Iterating with begin()/end() returns the chunks as Span. For HIMEM only
+ * one window is mapped at a time: a chunk is only valid until the next
+ * chunk is requested or the file is accessed again.
+ *
+ * Writing through a writable mapping changes the file content but never its
+ * size.
+ */
+template <typename VectorType, typename Byte>
+class FileMapping {
+ public:
+  /**
+   * @class iterator
+   * @brief Input iterator which returns the contiguous chunks of the range
+   */
+  class iterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Span<Byte>;
+    using difference_type = std::ptrdiff_t;
+    using reference = Span<Byte>;
+    using pointer = const Span<Byte>*;
+
+    iterator() = default;
+    iterator(VectorType* vec, size_t pos, size_t end)
+        : vec(vec), pos(pos), end(end) {
+      load();
+    }
+
+    Span<Byte> operator*() const { return chunk; }
+    const Span<Byte>* operator->() const { return &chunk; }
+    iterator& operator++() {
+      pos += chunk.size();
+      load();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator tmp = *this;
+      ++(*this);
+      return tmp;
+    }
+    bool operator==(const iterator& other) const { return pos == other.pos; }
+    bool operator!=(const iterator& other) const { return pos != other.pos; }
+
+    /**
+     * @brief Get the file offset of the current chunk
+     * @return Offset in bytes
+     */
+    size_t offset() const { return pos; }
+
+   private:
+    VectorType* vec = nullptr;
+    size_t pos = 0;
+    size_t end = 0;
+    Span<Byte> chunk;
+
+    void load() {
+      if (pos >= end) {
+        chunk = Span<Byte>();
+        return;
+      }
+      size_t count = end - pos;
+      Byte* ptr = bulkPointer(*vec, pos, count);
+      if (ptr == nullptr || count == 0) {
+        // storage not accessible: stop the iteration
+        pos = end;
+        chunk = Span<Byte>();
+        return;
+      }
+      chunk = Span<Byte>(ptr, count);
+    }
+  };
+
+  using const_iterator = iterator;
+
+  /**
+   * @brief Empty mapping
+   */
+  FileMapping() = default;
+
+  /**
+   * @brief Constructor
+   * @param vec The storage
+   * @param offset Start of the range
+   * @param len Length of the range (must be within the storage)
+   */
+  FileMapping(VectorType* vec, size_t offset, size_t len)
+      : vec(vec), offset_(offset), size_(len) {}
+
+  /**
+   * @brief Get the file offset of the range
+   * @return Offset in bytes
+   */
+  size_t offset() const { return offset_; }
+
+  /**
+   * @brief Get the length of the range
+   * @return Length in bytes
+   */
+  size_t size() const { return size_; }
+
+  /**
+   * @brief Check if the range is empty
+   * @return true if nothing is mapped
+   */
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * @brief Check if the whole range is accessible with a single pointer
+   * @return true if span() covers the whole range
+   */
+  bool contiguous() const { return span().size() == size_; }
+
+  /**
+   * @brief Get the first contiguous chunk of the range
+   * @return Span which covers the whole range if contiguous() is true
+   */
+  Span<Byte> span() const {
+    if (empty()) return Span<Byte>();
+    return *iterator(vec, offset_, offset_ + size_);
+  }
+
+  /**
+   * @brief Iterator to the first chunk
+   * @return iterator
+   */
+  iterator begin() const { return iterator(vec, offset_, offset_ + size_); }
+
+  /**
+   * @brief Iterator past the last chunk
+   * @return iterator
+   */
+  iterator end() const {
+    return iterator(vec, offset_ + size_, offset_ + size_);
+  }
+
+ protected:
+  VectorType* vec = nullptr;
+  size_t offset_ = 0;
+  size_t size_ = 0;
+};
+
+}  // namespace esp32_psram
@@ -2,7 +2,7 @@
 
 #include <Arduino.h>
 #include "InMemoryFS.h"
-#include "VectorHIMEM.h"
+#include "PagedVector.h"
 
 namespace esp32_psram {
 
@@ -14,7 +14,7 @@ namespace esp32_psram {
  * that are stored in HIMEM memory (beyond the 4MB boundary) rather than on an SD card.
  * HIMEM offers larger storage capacity but slightly slower access than regular PSRAM.
  */
-class HIMEMClass : public InMemoryFS<VectorHIMEM<uint8_t>, FileHIMEM> {
+class HIMEMClass : public InMemoryFS<PagedVectorHIMEM, FileHIMEM> {
 public:
     /**
      * @brief Initialize the HIMEM filesystem
@@ -30,19 +30,20 @@ public:
     }
 
     /**
-     * @brief Get total space (returns available HIMEM)
+     * @brief Get total space (returns available HIMEM, limited by the quota)
      * @return Total HIMEM size in bytes
      */
     uint64_t totalBytes() override {
-        return esp_himem_get_phys_size();
+        return limitTotal(esp_himem_get_phys_size());
     }
 
     /**
-     * @brief Get free space (returns free HIMEM)
+     * @brief Get free space (returns free HIMEM, limited by what is left of
+     * the quota)
      * @return Free HIMEM size in bytes
      */
     uint64_t freeBytes() override {
-        return esp_himem_get_free_size();
+        return limitFree(esp_himem_get_free_size());
     }
 };
 
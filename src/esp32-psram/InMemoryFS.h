@@ -2,19 +2,21 @@
 
 #include <Arduino.h>
 
-#include <map>
-
+#include "DirectoryTree.h"
+#include "FileMapping.h"
 #include "InMemoryFile.h"
+#include "Snapshot.h"
+#include "SpaceAccount.h"
 
-// Define Arduino file mode constants if not already defined
+// Define the Arduino file mode constants like FS.h if not already defined
 #ifndef FILE_READ
-#define FILE_READ 0
+#define FILE_READ "r"
 #endif
 #ifndef FILE_WRITE
-#define FILE_WRITE 1
+#define FILE_WRITE "w"
 #endif
 #ifndef FILE_APPEND
-#define FILE_APPEND 2
+#define FILE_APPEND "a"
 #endif
 
 namespace esp32_psram {
@@ -26,8 +28,20 @@ namespace esp32_psram {
  * This class provides a common interface for in-memory file systems,
  * with methods for file management and traversal.
  *
- * @tparam VectorType The vector implementation to use (VectorPSRAM or
- * VectorHIMEM)
+ * Files are organized in a DirectoryTree: each directory has a hash index,
+ * so opening a path costs O(1) expected time per path component and
+ * iterating a directory with openNextFile() never scans other files.
+ * Handles keep their directory entry as cursor: opening an existing file and
+ * stepping through a directory are allocation free.
+ *
+ * The file contents are reference-counted bodies which are shared by all
+ * handles of a file: removing a file only removes it from the directory, the
+ * content is released with the last open handle. The directory and each file
+ * body have their own reader-writer lock, so files can be used from several
+ * tasks.
+ *
+ * @tparam VectorType The vector implementation to use (PagedVectorPSRAM or
+ * PagedVectorHIMEM)
  * @tparam FileType The file implementation to return (FilePSRAM or FileHIMEM)
  */
 template <typename VectorType, typename FileType>
@@ -40,195 +54,212 @@ class InMemoryFS {
   virtual bool begin() = 0;
 
   /**
-   * @brief Check if a file exists
-   * @param filename Name of the file to check
+   * @brief Check if a file or directory exists
+   * @param filename Path of the file to check
    * @return true if the file exists, false otherwise
    */
   bool exists(const char* filename) {
     if (!initialized) return false;
-    return fileData.find(std::string(filename)) != fileData.end();
+    RWLock::ReadGuard guard(lock);
+    return tree.find(filename) != nullptr;
   }
 
   /**
-   * @brief Open a file
-   * @param filename Name of the file to open
-   * @param mode Mode to open the file in (FILE_READ, FILE_WRITE, etc.)
+   * @brief Open a file or directory
+   *
+   * Files which are opened for writing are created together with their
+   * parent directories. Directories can only be opened for reading and are
+   * iterated with openNextFile().
+   * @param filename Path of the file to open
+   * @param mode Mode like fs::FS: FILE_READ ("r"), FILE_WRITE ("w"),
+   * FILE_APPEND ("a"), "r+", "w+" or "a+"
    * @return A file object for the opened file
    */
-  FileType open(const char* filename, uint8_t mode) {
-    ESP_LOGD("InMemoryFS", "Opening file %s with mode %d", filename, mode);
-
-    if (!initialized) {
-      ESP_LOGW("InMemoryFS", "Filesystem not initialized");
-      FileType emptyFile;
-      return emptyFile;
-    }
-
-    // Convert Arduino file modes to our enum
-    FileMode fileMode;
-    if (mode == FILE_READ) {
-      fileMode = FileMode::READ;
-    } else if (mode == FILE_WRITE) {
-      fileMode = FileMode::WRITE;
-    } else if (mode == FILE_APPEND) {
-      fileMode = FileMode::APPEND;
-    } else {
-      fileMode = FileMode::READ_WRITE;
+  FileType open(const char* filename, const char* mode = FILE_READ) {
+    ESP_LOGD("InMemoryFS", "Opening file %s with mode %s", filename, mode);
+    if (mode == nullptr || mode[0] == 0) mode = "r";
+    bool update = mode[1] == '+';
+    if (mode[0] == 'r') {
+      return openFile(filename, update ? FileMode::READ_WRITE : FileMode::READ);
     }
-
-    std::string filenameStr(filename);
-    auto it = fileData.find(filenameStr);
-    FileType file;
-
-    if (it != fileData.end()) {
-      // File exists, create a new file pointing to existing data
-      ESP_LOGD("InMemoryFS", "File exists, connecting to existing data");
-      file.setVector(&(it->second));
-    } else if (mode != FILE_READ) {
-      // File doesn't exist, create it for writing or appending
-      ESP_LOGD("InMemoryFS", "Creating new file for writing");
-      fileData[filenameStr] = VectorType();  // Create empty vector in the map
-      file.setVector(&(fileData[filenameStr]));
-    } else {
-      // File doesn't exist and mode is READ
-      ESP_LOGW("InMemoryFS", "File doesn't exist and mode is READ");
-      return file;  // Return empty file
+    FileType file = openFile(
+        filename, mode[0] == 'a' ? FileMode::APPEND : FileMode::WRITE);
+    if (file && update) {
+      // "w+" truncates, "a+" starts at the end: then read and write
+      size_t end = file.size();
+      file.open(FileMode::READ_WRITE);
+      file.seek(end);
     }
-
-    // Configure the file
-    file.setName(filename);
-    file.open(fileMode);
-
-    // Set up the next file callback
-    file.setNextFileCallback(
-        [this](const char* currentFileName, FileMode currentMode) -> FileType {
-          ESP_LOGD("InMemoryFS", "NextFile callback called for %s",
-                   currentFileName);
-
-          // Get the next filename
-          String nextName = this->getNextFileName(currentFileName);
-          if (nextName.isEmpty()) {
-            ESP_LOGD("InMemoryFS", "No next file found");
-            return FileType();  // Return empty file if no next file
-          }
-
-          // Convert FileMode to Arduino mode
-          uint8_t arduinoMode;
-          if (currentMode == FileMode::READ)
-            arduinoMode = FILE_READ;
-          else if (currentMode == FileMode::WRITE)
-            arduinoMode = FILE_WRITE;
-          else if (currentMode == FileMode::APPEND)
-            arduinoMode = FILE_APPEND;
-          else
-            arduinoMode = FILE_READ | FILE_WRITE;
-
-          // Open and return the next file
-          ESP_LOGD("InMemoryFS", "Returning next file: %s", nextName.c_str());
-          return this->open(nextName.c_str(), arduinoMode);
-        });
-
-    ESP_LOGD("InMemoryFS", "File opened successfully");
     return file;
   }
 
+  /**
+   * @brief Open a file or directory with a numeric mode
+   * @param filename Path of the file to open
+   * @param mode 0 = read, 1 = write, 2 = append, other values = read and
+   * write
+   * @return A file object for the opened file
+   */
+  FileType open(const char* filename, uint8_t mode) {
+    ESP_LOGD("InMemoryFS", "Opening file %s with mode %d", filename, mode);
+    return openFile(filename, toFileMode(mode));
+  }
+
   /**
    * @brief Remove a file
-   * @param filename Name of the file to remove
+   * @param filename Path of the file to remove
    * @return true if the file was removed, false otherwise
    */
   bool remove(const char* filename) {
     if (!initialized) return false;
 
-    std::string filenameStr(filename);
-    auto it = fileData.find(filenameStr);
+    RWLock::WriteGuard guard(lock);
+    Entry* entry = tree.find(filename);
+    if (entry == nullptr || entry->isDirectory()) return false;
+    // open handles keep the body alive until they are released
+    return tree.remove(entry);
+  }
 
-    if (it != fileData.end()) {
-      fileData.erase(it);
-      return true;
+  /**
+   * @brief Copy a file without copying its content
+   *
+   * The copy shares the pages of the source (copy on write): a page is only
+   * duplicated when one of the files changes it, so a clone of a large file
+   * takes microseconds and almost no memory. In HIMEM the content is copied,
+   * because the mapped window belongs to the page.
+   * @param source Path of the file to copy
+   * @param target Path of the copy; an existing file is replaced and the
+   * missing directories are created
+   * @return true if successful
+   */
+  bool clone(const char* source, const char* target) {
+    if (!initialized) return false;
+    EntryPtr from;
+    {
+      RWLock::ReadGuard guard(lock);
+      from = tree.share(tree.find(source));
     }
+    if (!from || from->isDirectory()) return false;
+
+    VectorType content;
+    if (!copyContent(*from->body, content)) return false;
+    EntryPtr to;
+    {
+      RWLock::WriteGuard guard(lock);
+      to = tree.share(tree.makeFile(target));
+      if (!to) {
+        ESP_LOGW("InMemoryFS", "Can't create %s: a directory is in the way",
+                 target);
+        return false;
+      }
+      to->body->data.setAccount(space);
+    }
+    if (to == from) return true;
+    RWLock::WriteGuard guard(to->body->lock);
+    // content of a lazy restore would overwrite the copy
+    to->body->pending.source.reset();
+    to->body->pending.active.store(false, std::memory_order_release);
+    to->body->data = std::move(content);
+    return true;
+  }
 
-    return false;
+  /**
+   * @brief Freeze the current content of a file
+   *
+   * The result is a read-only handle of a copy which is not part of the
+   * directory tree: later changes of the file are not visible. Like clone()
+   * it shares the pages with the file, so it is cheap to take, e.g. to write
+   * a consistent state of a log to SD while the log continues. The memory is
+   * released with the last handle.
+   * @param path Path of the file
+   * @return The handle, which is not open if the file does not exist
+   */
+  FileType snapshot(const char* path) {
+    FileType file;
+    if (!initialized) return file;
+    EntryPtr from;
+    {
+      RWLock::ReadGuard guard(lock);
+      from = tree.share(tree.find(path));
+    }
+    if (!from || from->isDirectory()) return file;
+
+    auto body = std::allocate_shared<Body>(AllocatorPSRAM<Body>());
+    if (!copyContent(*from->body, body->data)) return file;
+    file.setBody(body);
+    file.setName(path);
+    file.open(FileMode::READ);
+    return file;
   }
 
   /**
-   * @brief Create a directory (no-op for compatibility)
-   * @param dirname Name of the directory
-   * @return Always returns true for compatibility
+   * @brief Create a directory together with the missing parent directories
+   * @param dirname Path of the directory
+   * @return true if the directory exists now, false if a file is in the way
    */
   bool mkdir(const char* dirname) {
-    // No directories in this implementation, just for compatibility
-    return true;
+    if (!initialized) return false;
+    RWLock::WriteGuard guard(lock);
+    return tree.makeDirectory(dirname) != nullptr;
   }
 
   /**
-   * @brief Remove a directory (no-op for compatibility)
-   * @param dirname Name of the directory
-   * @return Always returns true for compatibility
+   * @brief Remove a directory
+   * @param dirname Path of the directory
+   * @param recursive true to remove the directory with all its content
+   * @return true if removed, false if it does not exist or is not empty
    */
-  bool rmdir(const char* dirname) {
-    // No directories in this implementation, just for compatibility
-    return true;
+  bool rmdir(const char* dirname, bool recursive = false) {
+    if (!initialized) return false;
+    RWLock::WriteGuard guard(lock);
+    Entry* entry = tree.find(dirname);
+    if (entry == nullptr || !entry->isDirectory()) return false;
+    return tree.remove(entry, recursive);
   }
 
   /**
-   * @brief Get the name of the next file after the specified file
-   * @param currentFileName Name of the current file
-   * @return Name of the next file, or empty string if there are no more files
+   * @brief Get the path of the entry which follows an entry in its directory
+   * @param currentFileName Path of the current file, or "/" for the first
+   * entry of the root directory
+   * @return Path of the next file, or empty string if there are no more files
    */
   String getNextFileName(const char* currentFileName) {
-    if (!initialized || fileData.empty()) {
+    RWLock::ReadGuard guard(lock);
+    if (!initialized) {
       return String();
     }
 
     if (currentFileName == nullptr || strlen(currentFileName) == 0 ||
         strcmp(currentFileName, "/") == 0) {
       // Return the first file if current is empty or is root directory
-      return String(fileData.begin()->first.c_str());
+      return pathOf(tree.first(tree.root()));
     }
 
-    std::string current(currentFileName);
-    auto it = fileData.find(current);
-
-    if (it == fileData.end()) {
-      // Current file not found, find the next one alphabetically
-      for (auto& entry : fileData) {
-        if (entry.first > current) {
-          return String(entry.first.c_str());
-        }
-      }
-      // No file after the specified name
-      return String();
-    } else {
-      // Found the current file, get the next one
-      ++it;
-      if (it != fileData.end()) {
-        return String(it->first.c_str());
-      } else {
-        // Was the last file
-        return String();
-      }
-    }
+    // O(1) expected: lookup by hash, then step to the next entry
+    return pathOf(tree.next(tree.find(currentFileName)));
   }
 
   /**
-   * @brief Get the first file in the filesystem
-   * @return Name of the first file, or empty string if there are no files
+   * @brief Get the first entry of a directory
+   * @param dirname Path of the directory (default: root)
+   * @return Path of the first entry, or empty string if there is none
    */
-  String getFirstFileName() {
-    if (!initialized || fileData.empty()) {
+  String getFirstFileName(const char* dirname = "/") {
+    RWLock::ReadGuard guard(lock);
+    if (!initialized) {
       return String();
     }
-    return String(fileData.begin()->first.c_str());
+    return pathOf(tree.first(tree.find(dirname)));
   }
 
   /**
    * @brief Get the total number of files
-   * @return Number of files in the filesystem
+   * @return Number of files in the filesystem (without directories)
    */
   size_t fileCount() const {
     if (!initialized) return 0;
-    return fileData.size();
+    RWLock::ReadGuard guard(lock);
+    return tree.fileCount();
   }
 
   /**
@@ -243,9 +274,529 @@ class InMemoryFS {
    */
   virtual uint64_t freeBytes() = 0;
 
+  /**
+   * @brief Get the memory which is used by the files
+   *
+   * This is the memory which is actually allocated: whole pages (so it
+   * includes the unused part of the last page of each file and the HIMEM
+   * block rounding) and the page tables. Removed files are counted until
+   * their last handle is released.
+   * @return Used memory in bytes
+   */
+  uint64_t usedBytes() const { return space->used(); }
+
+  /**
+   * @brief Limit the memory which can be used by the files
+   *
+   * Writes which would need more memory are cut short, so a runaway logger
+   * can't starve the rest of the firmware. Memory which is already used is
+   * not affected.
+   * @param bytes The quota in bytes, 0 for no limit
+   */
+  void setQuota(uint64_t bytes) { space->setQuota(bytes); }
+
+  /**
+   * @brief Get the quota
+   * @return The quota in bytes, 0 if there is no limit
+   */
+  uint64_t quota() const { return space->quota(); }
+
+  /**
+   * @brief Write an image of all files and directories, e.g. to SD before a
+   * planned reboot
+   *
+   * The image starts with an index of all entries, followed by the file
+   * contents which are written directly from the storage in large blocks
+   * (see snapshot namespace for the format). No file is locked while the
+   * image is written, so the destination can be a file of the same file
+   * system:
+   * - PSRAM: all files are copied at the same moment (the copies share the
+   *   pages, see clone()), so the image shows this moment.
+   * - HIMEM: the files are copied one by one when their content is written,
+   *   so only one copy needs memory. The snapshot fails if a file was
+   *   changed after the index was written.
+   * @param out The destination
+   * @param checksums true to store a CRC-32 of each file
+   * @return Number of bytes written, 0 on failure
+   */
+  size_t snapshot(Print& out, bool checksums = true) {
+    if (!initialized) return 0;
+    VectorPSRAM<SnapshotEntry> entries;
+    if (!collectEntries(entries)) return 0;
+    size_t index_size = 0;
+    for (size_t j = 0; j < entries.size(); j++) {
+      SnapshotEntry& e = entries[j];
+      index_size += 3 + e.path.length() + (e.directory ? 0 : 8);
+      if (!e.directory && !measure(e, checksums)) return 0;
+    }
+
+    size_t total = 0;
+    bool ok = true;
+    auto put = [&](const uint8_t* data, size_t len) {
+      if (!ok) return;
+      size_t written = out.write(data, len);
+      total += written;
+      ok = written == len;
+    };
+
+    uint8_t header[snapshot::kHeaderSize] = {0};
+    memcpy(header, snapshot::kMagic, sizeof(snapshot::kMagic));
+    header[4] = snapshot::kVersion;
+    header[5] = checksums ? snapshot::kFlagChecksums : 0;
+    binary::storeNumber(header + 8, entries.size(), 4);
+    binary::storeNumber(header + 12, index_size, 4);
+    put(header, sizeof(header));
+
+    for (size_t j = 0; j < entries.size(); j++) {
+      SnapshotEntry& e = entries[j];
+      uint8_t record[8];
+      record[0] = e.directory ? snapshot::kTypeDirectory
+                              : snapshot::kTypeFile;
+      binary::storeNumber(record + 1, e.path.length(), 2);
+      put(record, 3);
+      put(reinterpret_cast<const uint8_t*>(e.path.c_str()), e.path.length());
+      if (e.directory) continue;
+      binary::storeNumber(record, e.size, 4);
+      binary::storeNumber(record + 4, e.crc, 4);
+      put(record, 8);
+    }
+
+    for (size_t j = 0; j < entries.size() && ok; j++) {
+      SnapshotEntry& e = entries[j];
+      if (e.directory) continue;
+      if (e.body && !copyUnchanged(e, checksums)) {
+        ok = false;
+        break;
+      }
+      // the mapping stops early if a HIMEM window can't be mapped
+      size_t done = 0;
+      for (Span<const uint8_t> chunk :
+           FileMapping<VectorType, const uint8_t>(&e.content, 0, e.size)) {
+        put(chunk.data(), chunk.size());
+        done += chunk.size();
+      }
+      if (done != e.size) ok = false;
+      releaseWindow(e.content);
+      e.content.clear();
+    }
+
+    if (!ok) ESP_LOGE("InMemoryFS", "snapshot: write failed");
+    return ok ? total : 0;
+  }
+
+  /**
+   * @brief Replace all files and directories with the content of an image
+   * which was written by snapshot()
+   *
+   * Files which are still open keep their old content.
+   * @param in The source
+   * @param verify true to check the CRC-32 of each file (if the image has
+   * checksums)
+   * @return true if the image was restored completely; files which failed
+   * the verification are empty
+   */
+  bool restore(Stream& in, bool verify = true) {
+    VectorPSRAM<RestoredFile> files;
+    uint8_t flags = 0;
+    size_t data_offset = 0;
+    if (!readIndex(in, files, flags, data_offset)) return false;
+    verify = verify && (flags & snapshot::kFlagChecksums);
+
+    bool ok = true;
+    uint8_t buffer[snapshot::kCopyBufferSize];
+    for (size_t j = 0; j < files.size(); j++) {
+      RestoredFile& file = files[j];
+      RWLock::WriteGuard guard(file.body->lock);
+      uint32_t crc = 0;
+      bool stored = true;
+      size_t done = 0;
+      while (done < file.size) {
+        size_t n = std::min(file.size - done, sizeof(buffer));
+        if (in.readBytes(buffer, n) != n) {
+          ESP_LOGE("InMemoryFS", "restore: image is truncated");
+          file.body->data.clear();
+          return false;
+        }
+        if (verify) crc = binary::crc32(crc, buffer, n);
+        // continue reading when the quota is exceeded to keep the position
+        if (stored) stored = bulkAppend(file.body->data, buffer, n) == n;
+        done += n;
+      }
+      releaseWindow(file.body->data);
+      if (!stored || (verify && crc != file.crc)) {
+        ESP_LOGE("InMemoryFS", "restore: file %u is incomplete or corrupted",
+                 (unsigned)j);
+        file.body->data.clear();
+        ok = false;
+      }
+    }
+    return ok;
+  }
+
+  /**
+   * @brief Replace all files and directories with the entries of an image
+   * which was written by snapshot(); the content of each file is only loaded
+   * when the file is opened for the first time
+   *
+   * The image must stay accessible until all files were opened. Files which
+   * fail the verification are empty and can't be opened the first time.
+   * @param image Seekable file with the image, e.g. fs::File of SD or
+   * LittleFS (a copy is kept)
+   * @param verify true to check the CRC-32 of each file (if the image has
+   * checksums)
+   * @return true if the index was read successfully
+   */
+  template <typename SeekableFile>
+  bool restoreLazy(SeekableFile image, bool verify = true) {
+    VectorPSRAM<RestoredFile> files;
+    uint8_t flags = 0;
+    size_t offset = 0;
+    if (!image.seek(0) || !readIndex(image, files, flags, offset)) {
+      return false;
+    }
+    std::shared_ptr<SnapshotSource> source =
+        std::allocate_shared<FileSnapshotSource<SeekableFile>>(
+            AllocatorPSRAM<FileSnapshotSource<SeekableFile>>(), image);
+    for (size_t j = 0; j < files.size(); j++) {
+      RestoredFile& file = files[j];
+      RWLock::WriteGuard guard(file.body->lock);
+      PendingContent& pending = file.body->pending;
+      pending.source = source;
+      pending.offset = offset;
+      pending.size = file.size;
+      pending.crc = file.crc;
+      pending.verify = verify && (flags & snapshot::kFlagChecksums);
+      pending.active.store(true, std::memory_order_release);
+      offset += file.size;
+    }
+    return true;
+  }
+
  protected:
+  using Body = FileBody<VectorType>;
+  using Tree = DirectoryTree<Body>;
+  using Entry = typename Tree::Entry;
+  using EntryPtr = typename Tree::EntryPtr;
+
   bool initialized = false;
-  std::map<std::string, VectorType> fileData;
+  // memory used by the file contents, shared with the storage of the files,
+  // which can outlive the file system
+  SpaceAccountPtr space = std::make_shared<SpaceAccount>();
+  Tree tree;
+  mutable RWLock lock;  // protects the directory tree, not the file content
+
+  /**
+   * @brief Limit the total size of the memory to the quota
+   * @param physical The size of the memory
+   * @return Total size available to the file system
+   */
+  uint64_t limitTotal(uint64_t physical) const {
+    uint64_t limit = space->quota();
+    return limit != 0 && limit < physical ? limit : physical;
+  }
+
+  /**
+   * @brief Limit the free memory to what is left of the quota
+   * @param physical The free memory of the device
+   * @return Free memory available to the file system
+   */
+  uint64_t limitFree(uint64_t physical) const {
+    uint64_t left = space->available();
+    return left < physical ? left : physical;
+  }
+
+  static String pathOf(Entry* entry) {
+    if (entry == nullptr) return String();
+    return entry->path();
+  }
+
+  /**
+   * @brief An entry of an image which is written
+   */
+  struct SnapshotEntry {
+    String path;
+    bool directory = false;
+    size_t size = 0;
+    uint32_t crc = 0;
+    VectorType content;  // copy of the file content
+    std::shared_ptr<Body> body;  // the file, if it is copied later (HIMEM)
+  };
+
+  /**
+   * @brief A file of an image which is restored
+   */
+  struct RestoredFile {
+    std::shared_ptr<Body> body;
+    size_t size;
+    uint32_t crc;
+  };
+
+  /**
+   * @brief Read the header and the index of an image and replace all
+   * existing entries with the entries of the image; nothing is changed if
+   * the index is invalid
+   * @param in The image, positioned at the start
+   * @param files The created files with their expected size and CRC
+   * @param flags The flags of the image
+   * @param data_offset Position of the first file content in the image
+   * @return true if the image is valid
+   */
+  bool readIndex(Stream& in, VectorPSRAM<RestoredFile>& files, uint8_t& flags,
+                 size_t& data_offset) {
+    if (!initialized) return false;
+    uint8_t header[snapshot::kHeaderSize];
+    if (in.readBytes(header, sizeof(header)) != sizeof(header) ||
+        memcmp(header, snapshot::kMagic, sizeof(snapshot::kMagic)) != 0 ||
+        header[4] != snapshot::kVersion) {
+      ESP_LOGE("InMemoryFS", "restore: not a file system image");
+      return false;
+    }
+    flags = header[5];
+    uint32_t count = binary::loadNumber(header + 8, 4);
+    uint32_t index_size = binary::loadNumber(header + 12, 4);
+    data_offset = snapshot::kHeaderSize + index_size;
+
+    // the entries are created aside and replace the existing ones only if
+    // the whole index is valid
+    Tree staged;
+    typename Tree::Name path;
+    uint32_t j = 0;
+    for (; j < count; j++) {
+      uint32_t type = 0, len = 0, size = 0, crc = 0;
+      if (!binary::readNumber(in, type, 1) ||
+          !binary::readNumber(in, len, 2)) {
+        break;
+      }
+      path.resize(len);
+      if (in.readBytes(&path[0], len) != len) break;
+      if (type == snapshot::kTypeDirectory) {
+        if (staged.makeDirectory(path.c_str()) == nullptr) break;
+        continue;
+      }
+      if (!binary::readNumber(in, size, 4) ||
+          !binary::readNumber(in, crc, 4)) {
+        break;
+      }
+      Entry* entry = staged.makeFile(path.c_str());
+      if (entry == nullptr) break;
+      entry->body->data.setAccount(space);
+      files.push_back(RestoredFile{entry->body, size, crc});
+    }
+    if (j != count) {
+      ESP_LOGE("InMemoryFS", "restore: invalid index");
+      files.clear();
+      return false;
+    }
+
+    RWLock::WriteGuard guard(lock);
+    tree.swap(staged);
+    // mark the old entries as removed for the handles which still use them
+    while (Tree::first(staged.root()) != nullptr) {
+      staged.remove(Tree::first(staged.root()), true);
+    }
+    return true;
+  }
+
+  /**
+   * @brief The content of a file as contiguous chunks
+   */
+  static FileMapping<VectorType, const uint8_t> contentOf(VectorType& data) {
+    return FileMapping<VectorType, const uint8_t>(&data, 0, data.size());
+  }
+
+  /**
+   * @brief Load a pending lazy restore and lock a file for reading
+   */
+  static void lockForSnapshot(Body& body) {
+    if (body.pending.active.load(std::memory_order_acquire)) {
+      RWLock::WriteGuard guard(body.lock);
+      body.pending.load(body.data);
+    }
+    // reading HIMEM storage maps a shared window, so it is exclusive
+    if (SharedReadAccess<VectorType>::value) {
+      body.lock.lockShared();
+    } else {
+      body.lock.lock();
+    }
+  }
+
+  static void unlockAfterSnapshot(Body& body) {
+    if (SharedReadAccess<VectorType>::value) {
+      body.lock.unlockShared();
+    } else {
+      body.lock.unlock();
+    }
+  }
+
+  /**
+   * @brief Copy the content of a file into empty storage which is charged
+   * to the file system
+   * @return false if the quota or the memory was exceeded
+   */
+  bool copyContent(Body& body, VectorType& content) {
+    content.setAccount(space);
+    lockForSnapshot(body);
+    content = body.data;
+    bool ok = content.size() == body.data.size();
+    releaseWindow(body.data);
+    releaseWindow(content);
+    unlockAfterSnapshot(body);
+    if (!ok) {
+      ESP_LOGW("InMemoryFS", "copy failed: not enough memory");
+      content.clear();
+    }
+    return ok;
+  }
+
+  /**
+   * @brief Collect all entries. In PSRAM the files are locked together and
+   * copied, so the copies are consistent; in HIMEM a copy needs as much
+   * memory as the file, so the files are copied one by one later.
+   * @return false if the quota or the memory was exceeded
+   */
+  bool collectEntries(VectorPSRAM<SnapshotEntry>& entries) {
+    RWLock::ReadGuard guard(lock);
+    Entry* root = tree.root();
+    size_t count = 0;
+    for (Entry* e = Tree::walk(root, root); e != nullptr;
+         e = Tree::walk(e, root)) {
+      count++;
+    }
+    entries.resize(count);
+    count = 0;
+    for (Entry* e = Tree::walk(root, root); e != nullptr;
+         e = Tree::walk(e, root)) {
+      SnapshotEntry& entry = entries[count++];
+      entry.path = e->path();
+      entry.directory = e->isDirectory();
+      if (!entry.directory) entry.body = e->body;
+    }
+    if (!SharedReadAccess<VectorType>::value) return true;
+
+    for (size_t j = 0; j < entries.size(); j++) {
+      if (entries[j].body) lockForSnapshot(*entries[j].body);
+    }
+    bool ok = true;
+    for (size_t j = 0; j < entries.size() && ok; j++) {
+      SnapshotEntry& entry = entries[j];
+      if (!entry.body) continue;
+      entry.content.setAccount(space);
+      entry.content = entry.body->data;
+      ok = entry.content.size() == entry.body->data.size();
+    }
+    for (size_t j = 0; j < entries.size(); j++) {
+      if (!entries[j].body) continue;
+      unlockAfterSnapshot(*entries[j].body);
+      entries[j].body.reset();
+    }
+    if (!ok) ESP_LOGE("InMemoryFS", "snapshot: not enough memory for copies");
+    return ok;
+  }
+
+  /**
+   * @brief Determine the size and the CRC-32 of a file for the index: of
+   * the copy, or of the file itself (which is locked for this)
+   */
+  bool measure(SnapshotEntry& e, bool checksums) {
+    if (e.body) lockForSnapshot(*e.body);
+    VectorType& data = e.body ? e.body->data : e.content;
+    e.size = data.size();
+    e.crc = 0;
+    size_t done = 0;
+    if (checksums) {
+      for (Span<const uint8_t> chunk : contentOf(data)) {
+        e.crc = binary::crc32(e.crc, chunk.data(), chunk.size());
+        done += chunk.size();
+      }
+    }
+    releaseWindow(data);
+    if (e.body) unlockAfterSnapshot(*e.body);
+    if (checksums && done != e.size) {
+      ESP_LOGE("InMemoryFS", "snapshot: could not read %s", e.path.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Copy a file whose size and CRC-32 are already in the index
+   * @return false if the copy failed or the file was changed
+   */
+  bool copyUnchanged(SnapshotEntry& e, bool checksums) {
+    if (!copyContent(*e.body, e.content)) return false;
+    e.body.reset();
+    // the destination of the image may be one of the files: it only grows
+    if (e.content.size() > e.size) e.content.resize(e.size);
+    bool same = e.content.size() == e.size;
+    if (same && checksums) {
+      uint32_t crc = 0;
+      for (Span<const uint8_t> chunk : contentOf(e.content)) {
+        crc = binary::crc32(crc, chunk.data(), chunk.size());
+      }
+      releaseWindow(e.content);
+      same = crc == e.crc;
+    }
+    if (!same) {
+      ESP_LOGE("InMemoryFS", "snapshot: %s was changed", e.path.c_str());
+    }
+    return same;
+  }
+
+  /**
+   * @brief Open a file or directory
+   * @param filename Path of the file to open
+   * @param fileMode The mode
+   * @return A file object for the opened file
+   */
+  FileType openFile(const char* filename, FileMode fileMode) {
+    if (!initialized) {
+      ESP_LOGW("InMemoryFS", "Filesystem not initialized");
+      return FileType();
+    }
+
+    // the handle refers to the directory entry: nothing is allocated for
+    // opening an existing file
+    FileType file;
+    EntryPtr entry;
+    {
+      RWLock::ReadGuard guard(lock);
+      entry = tree.share(tree.find(filename));
+    }
+
+    if (!entry) {
+      if (fileMode == FileMode::READ) {
+        ESP_LOGW("InMemoryFS", "File doesn't exist and mode is READ");
+        return file;  // Return empty file
+      }
+      // File doesn't exist, create it (and its directories) for writing
+      ESP_LOGD("InMemoryFS", "Creating new file for writing");
+      RWLock::WriteGuard guard(lock);
+      // another task might have created it in the meantime
+      entry = tree.share(tree.makeFile(filename));
+      if (!entry) {
+        ESP_LOGW("InMemoryFS", "Can't create %s: a directory is in the way",
+                 filename);
+        return file;
+      }
+      entry->body->data.setAccount(space);
+    } else if (entry->isDirectory() && fileMode != FileMode::READ) {
+      ESP_LOGW("InMemoryFS", "Directory %s can only be opened for reading",
+               filename);
+      return file;
+    }
+
+    file.setEntry(entry, &lock);
+    file.open(fileMode);
+    ESP_LOGD("InMemoryFS", "File opened successfully");
+    return file;
+  }
+
+  static FileMode toFileMode(uint8_t mode) {
+    if (mode == 0) return FileMode::READ;
+    if (mode == 1) return FileMode::WRITE;
+    if (mode == 2) return FileMode::APPEND;
+    return FileMode::READ_WRITE;
+  }
 };
 
 }  // namespace esp32_psram
\ No newline at end of file
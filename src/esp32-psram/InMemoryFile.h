@@ -2,6 +2,15 @@
 
 #include <Arduino.h>
 
+#include <memory>
+#include <type_traits>
+
+#include "DirectoryTree.h"
+#include "FileMapping.h"
+#include "PagedVector.h"
+#include "RWLock.h"
+#include "Snapshot.h"
+#include "VectorAccess.h"
 #include "VectorHIMEM.h"
 #include "VectorPSRAM.h"
 
@@ -10,6 +19,31 @@ namespace esp32_psram {
 // Define file modes
 enum class FileMode { READ, WRITE, APPEND, READ_WRITE };
 
+// Use the seek modes of fs::File if FS.h was included before, otherwise
+// the same values. FS.h is not included here: it defines FILE_READ etc. as
+// strings, which only sketches which use it should get.
+#ifdef FS_H
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+#else
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+#endif
+
+/**
+ * @struct FileBody
+ * @brief The content of a file together with the lock which protects it
+ * @tparam VectorType The vector implementation which stores the content
+ */
+template <typename VectorType>
+struct FileBody {
+  VectorType data;
+  RWLock lock;
+  /// Content of a lazy restore which is loaded with the first open
+  PendingContent pending;
+};
+
 /**
  * @class InMemoryFile
  * @brief A file-like interface for vector-backed storage in memory
@@ -26,11 +60,17 @@ enum class FileMode { READ, WRITE, APPEND, READ_WRITE };
  * where file operations are needed but filesystem access is not available
  * or desirable.
  *
- * The class can either manage its own internal vector or reference an external
- * vector supplied by another component (like PSRAMClass or HIMEMClass).
+ * The content is kept in a reference-counted FileBody, which is either owned
+ * by this file alone or shared with other handles of the same file (like the
+ * files of PSRAMClass or HIMEMClass). Each operation holds the reader-writer
+ * lock of the body, so several tasks can read a file in parallel while
+ * writes are exclusive. Reading HIMEM storage is exclusive as well, because
+ * it maps a shared window. Mappings (map(), lines()) are not protected while
+ * they are iterated.
  *
  * @tparam VectorType The vector implementation to use for storage (typically
- *                   VectorPSRAM<uint8_t> or VectorHIMEM<uint8_t>)
+ *                   PagedVectorPSRAM or PagedVectorHIMEM; VectorPSRAM<uint8_t>
+ *                   and VectorHIMEM<uint8_t> are supported as well)
  *
  * @note The performance characteristics will depend on the underlying vector
  *       implementation. HIMEM operations are generally slower than regular
@@ -39,13 +79,97 @@ enum class FileMode { READ, WRITE, APPEND, READ_WRITE };
 template <typename VectorType>
 class InMemoryFile : public Stream {
  public:
-  // Define a single callback type that returns the next file directly
-  using NextFileCallback =
-      std::function<InMemoryFile<VectorType>(const char*, FileMode)>;
+  /// Content and lock of a file, which is shared by all its handles
+  using Body = FileBody<VectorType>;
+
+  /// Read-only view of a byte range of the file content
+  using ReadMapping = FileMapping<VectorType, const uint8_t>;
+  /// Writable view of a byte range of the file content
+  using WriteMapping = FileMapping<VectorType, uint8_t>;
+
   /**
-   * @brief Default constructor - initializes with internal vector
+   * @class LineIterator
+   * @brief Input iterator which returns the lines of a file as ReadMapping
+   *
+   * The line terminator ('\n' or "\r\n") is not part of the line.
    */
-  InMemoryFile() : data_ptr(&internal_data) {
+  class LineIterator {
+   public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = ReadMapping;
+    using difference_type = std::ptrdiff_t;
+    using reference = ReadMapping;
+    using pointer = const ReadMapping*;
+
+    LineIterator() = default;
+    LineIterator(InMemoryFile* file, size_t pos) : file(file), pos(pos) {
+      findEnd();
+    }
+
+    ReadMapping operator*() const {
+      ReadLock guard(file->bodyLock());
+      size_t len = lineEnd - pos;
+      if (len > 0 && file->byteAt(lineEnd - 1) == '\r') len--;
+      return ReadMapping(file->data_ptr, pos, len);
+    }
+    LineIterator& operator++() {
+      pos = lineEnd < file->size() ? lineEnd + 1 : lineEnd;
+      findEnd();
+      return *this;
+    }
+    LineIterator operator++(int) {
+      LineIterator tmp = *this;
+      ++(*this);
+      return tmp;
+    }
+    bool operator==(const LineIterator& other) const {
+      return pos == other.pos;
+    }
+    bool operator!=(const LineIterator& other) const {
+      return pos != other.pos;
+    }
+
+   private:
+    InMemoryFile* file = nullptr;
+    size_t pos = 0;
+    size_t lineEnd = 0;
+
+    void findEnd() {
+      if (file == nullptr) {
+        lineEnd = pos;
+        return;
+      }
+      ReadLock guard(file->bodyLock());
+      // the file might have been truncated below the position
+      pos = min(pos, file->data_ptr->size());
+      lineEnd = file->scanFor('\n', pos);
+    }
+  };
+
+  /**
+   * @class LineRange
+   * @brief The lines of a file starting at a position, for range based loops
+   */
+  class LineRange {
+   public:
+    LineRange(InMemoryFile* file, size_t pos) : file(file), pos(pos) {}
+    LineIterator begin() const { return LineIterator(file, pos); }
+    LineIterator end() const { return LineIterator(file, file->size()); }
+
+   private:
+    InMemoryFile* file;
+    size_t pos;
+  };
+
+  using Tree = DirectoryTree<Body>;
+  using Entry = typename Tree::Entry;
+  using EntryPtr = typename Tree::EntryPtr;
+
+  /**
+   * @brief Default constructor - the storage is allocated when the file is
+   * opened for writing
+   */
+  InMemoryFile() : data_ptr(&emptyBody().data) {
     ESP_LOGD(TAG, "InMemoryFile constructor called");
   }
 
@@ -55,7 +179,7 @@ class InMemoryFile : public Stream {
    * @param mode Mode to open the file in
    */
   InMemoryFile(const char* filename, FileMode mode)
-      : data_ptr(&internal_data), name_(filename) {
+      : data_ptr(&emptyBody().data), name_(filename) {
     ESP_LOGD(TAG, "InMemoryFile constructor with name and mode called");
     open(mode);
   }
@@ -66,24 +190,67 @@ class InMemoryFile : public Stream {
   virtual ~InMemoryFile() {
     ESP_LOGD(TAG, "InMemoryFile destructor called");
     close();
-    if (!using_external_vector) {
-      data_ptr = nullptr;
+  }
+
+  /**
+   * @brief Set the shared file body (content and lock) to use for this file
+   *
+   * All handles which use the same body see the same content and are
+   * synchronized. The body stays alive as long as a handle uses it, even if
+   * the file is removed from the file system.
+   * @param newBody The body, nullptr for a new empty body
+   */
+  void setBody(std::shared_ptr<Body> newBody) {
+    ESP_LOGD(TAG, "Setting file body: %p", newBody.get());
+    body = newBody ? newBody : std::make_shared<Body>();
+    data_ptr = &body->data;
+  }
+
+  /**
+   * @brief Get the shared file body
+   * @return The body with the content and the lock of the file
+   */
+  std::shared_ptr<Body> getBody() const { return body; }
+
+  /**
+   * @brief Connect this handle to an entry of a file system directory
+   *
+   * The handle shares the body of a file and uses the entry as cursor for
+   * getNextFile() and openNextFile(), so no lookup by name is needed.
+   * Connecting does not allocate any memory.
+   * @param entry The file or directory entry
+   * @param treeLock The lock which protects the directory tree
+   */
+  void setEntry(EntryPtr entry, RWLock* treeLock) {
+    entry_ = entry;
+    tree_lock = treeLock;
+    cursor_.reset();
+    if (entry_ && !entry_->isDirectory()) {
+      body = entry_->body;
+      data_ptr = &body->data;
+    } else {
+      body.reset();
+      data_ptr = &emptyBody().data;
     }
   }
 
   /**
-   * @brief Set the vector to use for this file
-   * @param vec Pointer to the vector to use
+   * @brief Get the directory entry of this handle
+   * @return The entry, nullptr if the file is not part of a file system
+   */
+  EntryPtr getEntry() const { return entry_; }
+
+  /**
+   * @brief Set an external vector to use for this file
+   *
+   * The caller must keep the vector alive and synchronize the access; use
+   * setBody() for shared files.
+   * @param vec Pointer to the vector to use, nullptr for a new empty body
    */
   void setVector(VectorType* vec) {
     ESP_LOGD(TAG, "Setting external vector pointer: %p", vec);
-    if (vec) {
-      data_ptr = vec;
-      using_external_vector = true;
-    } else {
-      data_ptr = &internal_data;
-      using_external_vector = false;
-    }
+    setBody(nullptr);
+    if (vec) data_ptr = vec;
   }
 
   /**
@@ -103,15 +270,32 @@ class InMemoryFile : public Stream {
   bool open(FileMode mode) {
     ESP_LOGD(TAG, "Opening file '%s' with mode %d", name_.c_str(),
              static_cast<int>(mode));
+    if (isDirectory() && mode != FileMode::READ) {
+      ESP_LOGW(TAG, "A directory can only be opened for reading");
+      return false;
+    }
+    // content of a lazy restore is loaded with the first open
+    if (body && body->pending.active.load(std::memory_order_acquire)) {
+      RWLock::WriteGuard guard(body->lock);
+      if (!body->pending.load(body->data)) {
+        open_ = false;
+        return false;
+      }
+    }
     this->mode = mode;
+    // a file which is only read does not need its own storage
+    if (mode != FileMode::READ && !body && data_ptr == &emptyBody().data) {
+      setBody(nullptr);
+    }
 
     if (mode == FileMode::WRITE) {
       // Clear the vector for writing
+      RWLock::WriteGuard guard(bodyLock());
       data_ptr->clear();
       position_ = 0;
     } else if (mode == FileMode::APPEND) {
       // Position at end for appending
-      position_ = data_ptr->size();
+      position_ = size();
     } else {
       // READ or READ_WRITE - position at beginning
       position_ = 0;
@@ -126,6 +310,11 @@ class InMemoryFile : public Stream {
    */
   void close() {
     ESP_LOGD(TAG, "Closing file '%s'", name_.c_str());
+    if (open_ && data_ptr != nullptr) {
+      // a HIMEM file does not keep a map range while it is closed
+      ReadLock guard(bodyLock());
+      releaseWindow(*data_ptr);
+    }
     open_ = false;
   }
 
@@ -139,13 +328,20 @@ class InMemoryFile : public Stream {
    * @brief Get the name of the file
    * @return File name
    */
-  String name() const { return name_; }
+  String name() const {
+    if (!entry_) return name_;
+    RWLock::ReadGuard guard(*tree_lock);
+    return entry_->path();
+  }
 
   /**
    * @brief Get the size of the file
    * @return File size in bytes
    */
-  size_t size() const { return data_ptr->size(); }
+  size_t size() const {
+    ReadLock guard(bodyLock());
+    return data_ptr->size();
+  }
 
   // Stream interface implementation
 
@@ -154,6 +350,7 @@ class InMemoryFile : public Stream {
    * @return The next byte, or -1 if no data is available
    */
   int read() override {
+    ReadLock guard(bodyLock());
     ESP_LOGD(TAG, "InMemoryFile::read() - position %u", (unsigned)position_);
     if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
       ESP_LOGE(TAG, "read failed: file not open for reading");
@@ -166,7 +363,8 @@ class InMemoryFile : public Stream {
       return -1;  // EOF
     }
 
-    uint8_t byte = (*data_ptr)[position_++];
+    uint8_t byte = 0;
+    position_ += bulkRead(*data_ptr, position_, &byte, 1);
     return byte;
   }
 
@@ -177,6 +375,7 @@ class InMemoryFile : public Stream {
    * @return Number of bytes actually read
    */
   size_t readBytes(char* buffer, size_t size) override {
+    ReadLock guard(bodyLock());
     ESP_LOGD(TAG, "InMemoryFile::readBytes: %u", (unsigned)size);
     if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
       ESP_LOGE(TAG, "read failed: file not open for reading");
@@ -184,25 +383,226 @@ class InMemoryFile : public Stream {
     }
 
     // Calculate how many bytes we can actually read
-    size_t available_bytes = data_ptr->size() - position_;
-    size_t bytes_to_read = min(size, available_bytes);
+    size_t bytes_to_read = min(size, remaining());
 
-    // Read the bytes
-    for (size_t i = 0; i < bytes_to_read; i++) {
-      buffer[i] = (*data_ptr)[position_ + i];
-    }
+    // Read the bytes with memcpy sized copies
+    bytes_to_read = bulkRead(*data_ptr, position_,
+                             reinterpret_cast<uint8_t*>(buffer), bytes_to_read);
 
     position_ += bytes_to_read;
     return bytes_to_read;
   }
 
+  /**
+   * @brief Write the data from the current position directly to a stream
+   *
+   * The data is passed to the output straight from the backing storage
+   * (contiguous memory for PSRAM, the mapped window for HIMEM) without an
+   * intermediate buffer. The position is advanced by the bytes written.
+   * @param out Destination
+   * @param max Maximum number of bytes to transfer
+   * @return Number of bytes transferred
+   */
+  size_t writeTo(Print& out, size_t max = SIZE_MAX) {
+    ReadLock guard(bodyLock());
+    ESP_LOGD(TAG, "InMemoryFile::writeTo: %u", (unsigned)max);
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "read failed: file not open for reading");
+      return 0;
+    }
+
+    size_t total = 0;
+    while (total < max && position_ < data_ptr->size()) {
+      size_t count = max - total;
+      const uint8_t* ptr = bulkPointer(*data_ptr, position_, count);
+      if (ptr == nullptr) break;
+      size_t written = out.write(ptr, count);
+      position_ += written;
+      total += written;
+      if (written < count) break;
+    }
+    return total;
+  }
+
+  /**
+   * @brief Access a range of the file content without copies
+   *
+   * The result provides the range as contiguous chunks which point directly
+   * into the backing storage (see FileMapping). The file position is not
+   * changed.
+   * @param offset Start of the range
+   * @param len Length of the range (limited by the file size)
+   * @return The read-only mapping, empty if the file is not readable
+   */
+  ReadMapping map(size_t offset, size_t len = SIZE_MAX) {
+    ReadLock guard(bodyLock());
+    ESP_LOGD(TAG, "InMemoryFile::map: %u, %u", (unsigned)offset,
+             (unsigned)len);
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "map failed: file not open for reading");
+      return ReadMapping();
+    }
+    if (offset > data_ptr->size()) return ReadMapping();
+    return ReadMapping(data_ptr, offset,
+                       min(len, data_ptr->size() - offset));
+  }
+
+  /**
+   * @brief Access a range of the file content for writing without copies
+   *
+   * Writing through the mapping changes the content but not the size of the
+   * file. The file position is not changed.
+   * @param offset Start of the range
+   * @param len Length of the range (limited by the file size)
+   * @return The writable mapping, empty if the file is not writable
+   */
+  WriteMapping mapWritable(size_t offset, size_t len = SIZE_MAX) {
+    RWLock::WriteGuard guard(bodyLock());
+    ESP_LOGD(TAG, "InMemoryFile::mapWritable: %u, %u", (unsigned)offset,
+             (unsigned)len);
+    if (!open_ || (mode != FileMode::WRITE && mode != FileMode::APPEND &&
+                   mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "map failed: file not open for writing");
+      return WriteMapping();
+    }
+    if (offset > data_ptr->size()) return WriteMapping();
+    len = min(len, data_ptr->size() - offset);
+    // pages which are shared with clones get their own copy
+    if (!makeWritable(*data_ptr, offset, len)) return WriteMapping();
+    return WriteMapping(data_ptr, offset, len);
+  }
+
+  using Stream::find;
+  using Stream::readBytesUntil;
+
+  /**
+   * @brief Read until a terminator, which is consumed but not stored
+   *
+   * Replaces the per-byte implementation of Stream: the terminator is
+   * located with memchr on the backing storage and the data is copied in
+   * bulk.
+   * @param terminator The character to stop at
+   * @param buffer Buffer to store the read data
+   * @param length Maximum number of bytes to store
+   * @return Number of bytes stored
+   */
+  size_t readBytesUntil(char terminator, char* buffer, size_t length) {
+    ReadLock guard(bodyLock());
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "read failed: file not open for reading");
+      return 0;
+    }
+    size_t end = scanFor(terminator, position_);
+    // another handle may have truncated the file below the position
+    size_t count = end > position_ ? min(length, end - position_) : 0;
+    count = bulkRead(*data_ptr, position_, reinterpret_cast<uint8_t*>(buffer),
+                     count);
+    position_ += count;
+    // like Stream: the terminator is only consumed if it fitted
+    if (position_ == end && end < data_ptr->size()) position_++;
+    return count;
+  }
+
+  /**
+   * @brief Read a String until a terminator, which is consumed but not stored
+   * @param terminator The character to stop at
+   * @return The data before the terminator
+   */
+  String readStringUntil(char terminator) {
+    ReadLock guard(bodyLock());
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "read failed: file not open for reading");
+      return String();
+    }
+    size_t end = scanFor(terminator, position_);
+    String result = readStringTo(end);
+    if (position_ < data_ptr->size()) position_++;
+    return result;
+  }
+
+  /**
+   * @brief Read the rest of the file into a String
+   * @return The data from the current position to the end of the file
+   */
+  String readString() {
+    ReadLock guard(bodyLock());
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "read failed: file not open for reading");
+      return String();
+    }
+    return readStringTo(data_ptr->size());
+  }
+
+  /**
+   * @brief Skip the data until after the target sequence
+   *
+   * Candidates are located with memchr on the backing storage.
+   * @param target The sequence to search for
+   * @param length Length of the sequence
+   * @return true if found (the position is after the target), false if not
+   * found (the position is at the end of the file)
+   */
+  bool find(const char* target, size_t length) {
+    ReadLock guard(bodyLock());
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "find failed: file not open for reading");
+      return false;
+    }
+    if (length == 0) return true;
+    size_t pos = position_;
+    while ((pos = scanFor(target[0], pos)) < data_ptr->size()) {
+      if (matchesAt(pos, reinterpret_cast<const uint8_t*>(target), length)) {
+        position_ = pos + length;
+        return true;
+      }
+      pos++;
+    }
+    position_ = data_ptr->size();
+    return false;
+  }
+
+  /**
+   * @brief Skip the data until after the target string
+   * @param target The zero terminated string to search for
+   * @return true if found, false otherwise
+   */
+  bool find(const char* target) { return find(target, strlen(target)); }
+
+  /**
+   * @brief Skip the data until after the target character
+   * @param target The character to search for
+   * @return true if found, false otherwise
+   */
+  bool find(char target) { return find(&target, 1); }
+
+  /**
+   * @brief Iterate over the lines from the current position without copies
+   *
+   * Each line is returned as ReadMapping which points into the backing
+   * storage. The position of the file is not changed.
+   * @code
+   * for (auto line : file.lines()) {
+   *   for (auto chunk : line) parse(chunk.data(), chunk.size());
+   * }
+   * @endcode
+   * @return Range of lines
+   */
+  LineRange lines() {
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "lines failed: file not open for reading");
+      return LineRange(this, size());
+    }
+    return LineRange(this, position_);
+  }
+
   /**
    * @brief Get the number of bytes available to read
    * @return Number of bytes available
    */
   int available() override {
+    ReadLock guard(bodyLock());
     if (!open_) return 0;
-    return data_ptr->size() - position_;
+    return remaining();
   }
 
   /**
@@ -210,6 +610,7 @@ class InMemoryFile : public Stream {
    * @return The next byte, or -1 if no data is available
    */
   int peek() override {
+    ReadLock guard(bodyLock());
     if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
       return -1;
     }
@@ -218,7 +619,9 @@ class InMemoryFile : public Stream {
       return -1;  // EOF
     }
 
-    return (*data_ptr)[position_];
+    uint8_t byte = 0;
+    bulkRead(*data_ptr, position_, &byte, 1);
+    return byte;
   }
 
   /**
@@ -235,6 +638,7 @@ class InMemoryFile : public Stream {
    * @return 1 if the byte was written, 0 otherwise
    */
   size_t write(uint8_t b) override {
+    RWLock::WriteGuard guard(bodyLock());
     ESP_LOGD(TAG, "InMemoryFile::write: 1 byte");
     if (!open_ || (mode != FileMode::WRITE && mode != FileMode::APPEND &&
                    mode != FileMode::READ_WRITE)) {
@@ -242,16 +646,9 @@ class InMemoryFile : public Stream {
       return 0;
     }
 
-    if (position_ >= data_ptr->size()) {
-      // Append to the end
-      data_ptr->push_back(b);
-    } else {
-      // Replace existing byte
-      (*data_ptr)[position_] = b;
-    }
-
-    position_++;
-    return 1;
+    size_t written = writeAt(position_, &b, 1);
+    position_ += written;
+    return written;
   }
 
   /**
@@ -261,6 +658,7 @@ class InMemoryFile : public Stream {
    * @return Number of bytes actually written
    */
   size_t write(const uint8_t* buffer, size_t size) override {
+    RWLock::WriteGuard guard(bodyLock());
     ESP_LOGD(TAG, "InMemoryFile::write: %u", (unsigned)size);
     if (!open_ || (mode != FileMode::WRITE && mode != FileMode::APPEND &&
                    mode != FileMode::READ_WRITE)) {
@@ -268,34 +666,80 @@ class InMemoryFile : public Stream {
       return 0;
     }
 
-    if (position_ >= data_ptr->size()) {
-      // Append to the end
-      data_ptr->reserve(data_ptr->size() + size);  // Optimize capacity
-      for (size_t i = 0; i < size; i++) {
-        data_ptr->push_back(buffer[i]);
-      }
-    } else {
-      // Replace/insert bytes
-      size_t space_available = data_ptr->size() - position_;
-      size_t bytes_to_replace = min(size, space_available);
-      size_t bytes_to_append = size - bytes_to_replace;
-
-      // Replace existing bytes
-      for (size_t i = 0; i < bytes_to_replace; i++) {
-        (*data_ptr)[position_ + i] = buffer[i];
-      }
+    size_t written = writeAt(position_, buffer, size);
+    position_ += written;
+    return written;
+  }
 
-      // Append remaining bytes
-      for (size_t i = 0; i < bytes_to_append; i++) {
-        data_ptr->push_back(buffer[bytes_to_replace + i]);
-      }
+  // File-specific methods
+
+  /**
+   * @brief Read from an offset without changing the current position
+   *
+   * Several readers can share one handle, since the position is not used.
+   * @param buffer Buffer to store the read data
+   * @param size Maximum number of bytes to read
+   * @param offset Position in the file to read from
+   * @return Number of bytes actually read
+   */
+  size_t pread(void* buffer, size_t size, size_t offset) {
+    ReadLock guard(bodyLock());
+    ESP_LOGD(TAG, "InMemoryFile::pread: %u at %u", (unsigned)size,
+             (unsigned)offset);
+    if (!open_ || (mode != FileMode::READ && mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "pread failed: file not open for reading");
+      return 0;
     }
+    return bulkRead(*data_ptr, offset, static_cast<uint8_t*>(buffer), size);
+  }
 
-    position_ += size;
-    return size;
+  /**
+   * @brief Write at an offset without changing the current position
+   *
+   * Existing bytes are overwritten and the file grows if the data extends
+   * beyond the end. The offset must not be beyond the end of the file.
+   * @param buffer Buffer containing the data to write
+   * @param size Number of bytes to write
+   * @param offset Position in the file to write to
+   * @return Number of bytes actually written
+   */
+  size_t pwrite(const void* buffer, size_t size, size_t offset) {
+    RWLock::WriteGuard guard(bodyLock());
+    ESP_LOGD(TAG, "InMemoryFile::pwrite: %u at %u", (unsigned)size,
+             (unsigned)offset);
+    if (!open_ || (mode != FileMode::WRITE && mode != FileMode::APPEND &&
+                   mode != FileMode::READ_WRITE)) {
+      ESP_LOGE(TAG, "pwrite failed: file not open for writing");
+      return 0;
+    }
+    if (offset > data_ptr->size()) {
+      ESP_LOGE(TAG, "pwrite failed: offset beyond size");
+      return 0;
+    }
+    return writeAt(offset, static_cast<const uint8_t*>(buffer), size);
   }
 
-  // File-specific methods
+  /**
+   * @brief Set the current position relative to the start, the current
+   * position or the end of the file (like fs::File::seek)
+   * @param offset The offset, which can be negative for SeekCur and SeekEnd
+   * @param seekMode SeekSet, SeekCur or SeekEnd (of this library or of
+   * fs::File)
+   * @return true if successful, false otherwise
+   */
+  bool seek(long offset, int seekMode) {
+    long base = 0;
+    if (seekMode == SeekCur) {
+      base = position_;
+    } else if (seekMode == SeekEnd) {
+      base = size();
+    }
+    if (offset < 0 && base < -offset) {
+      ESP_LOGE(TAG, "seek failed: position before start of file");
+      return false;
+    }
+    return seek(static_cast<size_t>(base + offset));
+  }
 
   /**
    * @brief Set the current position in the file
@@ -303,6 +747,7 @@ class InMemoryFile : public Stream {
    * @return true if successful, false otherwise
    */
   bool seek(size_t pos) {
+    ReadLock guard(bodyLock());
     ESP_LOGD(TAG, "InMemoryFile::seek: %u", (unsigned)pos);
     if (!open_ || pos > data_ptr->size()) {
       ESP_LOGE(TAG, "seek failed: file not open or position beyond size");
@@ -323,6 +768,7 @@ class InMemoryFile : public Stream {
    * @brief Truncate the file to the current position
    */
   void truncate() {
+    RWLock::WriteGuard guard(bodyLock());
     ESP_LOGD(TAG, "InMemoryFile::truncate at position %u", (unsigned)position_);
     if (!open_ || (mode != FileMode::WRITE && mode != FileMode::READ_WRITE)) {
       ESP_LOGE(TAG, "truncate failed: file not open for writing");
@@ -330,58 +776,65 @@ class InMemoryFile : public Stream {
     }
 
     if (position_ < data_ptr->size()) {
-      // Create a new vector with just the data up to position_
-      VectorType new_data;
-      new_data.reserve(position_);
-      for (size_t i = 0; i < position_; i++) {
-        new_data.push_back((*data_ptr)[i]);
-      }
-
-      // Replace the old data
-      *data_ptr = std::move(new_data);
+      // Drop the data after position_ (the capacity is kept)
+      data_ptr->resize(position_);
     }
   }
 
   operator bool() const { return open_; }
+
   /**
-   * @brief Set callback for navigating to the next file
+   * @brief Get the next file in the same directory of the file system
    *
-   * This function sets a callback that will be used to retrieve the next
-   * file when getNextFile() is called. The callback takes the current file name
-   * and mode, and returns the next file object directly.
+   * The next file is opened in the mode of this file. This is O(1): the
+   * handle keeps its directory entry as cursor.
    *
-   * @param callback Function that returns the next file
+   * @return The next file, or an empty file if there is no next file or
+   * this file is not part of a file system
    */
-  void setNextFileCallback(NextFileCallback callback) {
-    ESP_LOGD(TAG, "Setting next file callback");
-    nextFileCallback = callback;
+  InMemoryFile<VectorType> getNextFile() {
+    InMemoryFile<VectorType> result;
+    if (!entry_) return result;
+    result.setEntry(nextEntry(entry_), tree_lock);
+    if (result.entry_) result.open(mode);
+    return result;
   }
 
   /**
-   * @brief Get the next file in the filesystem
-   *
-   * This method uses the registered callback to get the next file
-   * after this one in the filesystem.
-   *
-   * @return The next file, or an empty file if there is no next file or
-   * callback isn't set
+   * @brief Check if this handle represents a directory
+   * @return true for a directory
    */
-  InMemoryFile<VectorType> getNextFile() {
-    if (!nextFileCallback || name_.isEmpty()) {
-      // Return empty file if callback isn't set or no name
-      InMemoryFile<VectorType> emptyFile;
-      return emptyFile;
-    }
+  bool isDirectory() const { return entry_ && entry_->isDirectory(); }
 
-    // Get the next file directly using the callback
-    return nextFileCallback(name_.c_str(), mode);
+  /**
+   * @brief Get the next entry of a directory
+   *
+   * The first call returns the first entry of the directory, each following
+   * call the entry after the one which was returned before. Each step is
+   * O(1) and continues correctly if the last returned entry was removed.
+   * @return The next file or directory, or an empty file at the end
+   */
+  InMemoryFile<VectorType> openNextFile() {
+    InMemoryFile<VectorType> result;
+    if (!isDirectory()) return result;
+    cursor_ = cursor_ ? nextEntry(cursor_) : firstEntry(entry_);
+    result.setEntry(cursor_, tree_lock);
+    if (cursor_) result.open(FileMode::READ);
+    return result;
   }
 
+  /**
+   * @brief Restart openNextFile() with the first entry of the directory
+   */
+  void rewindDirectory() { cursor_.reset(); }
+
   /**
    * @brief Reserve storage
    * @param new_cap The new capacity of the file
    */
   bool reserve(size_t new_cap) {
+    if (!body && data_ptr == &emptyBody().data) setBody(nullptr);
+    RWLock::WriteGuard guard(bodyLock());
     if (data_ptr == nullptr) return false;
     data_ptr->reserve(new_cap);
     return true;
@@ -393,29 +846,148 @@ class InMemoryFile : public Stream {
    * @return The capacity of the file
    */
   size_t capacity() const {
+    ReadLock guard(bodyLock());
     if (data_ptr == nullptr) return 0;
     return data_ptr->capacity();
   }
 
  private:
-  VectorType* data_ptr =
-      nullptr;               // Pointer to vector data (internal or external)
-  VectorType internal_data;  // Internal vector for standalone use
-  bool using_external_vector = false;
+  // Reads of HIMEM storage remap the shared window, so they are exclusive
+  using ReadLock =
+      typename std::conditional<SharedReadAccess<VectorType>::value,
+                                RWLock::ReadGuard, RWLock::WriteGuard>::type;
+
+  std::shared_ptr<Body> body;  // Shared content and lock
+  VectorType* data_ptr = nullptr;  // The content (in body unless external)
   size_t position_ = 0;
   bool open_ = false;
   FileMode mode = FileMode::READ;
-  String name_;
+  String name_;  // Name of a file which is not part of a file system
+  EntryPtr entry_;  // Directory entry of a file system file
+  EntryPtr cursor_;  // Entry which openNextFile() returned last
+  RWLock* tree_lock = nullptr;  // Protects the links of the entries
+
+  /**
+   * @brief Number of bytes after the position; 0 if another handle truncated
+   * the file below the position
+   */
+  size_t remaining() const {
+    size_t size = data_ptr->size();
+    return position_ < size ? size - position_ : 0;
+  }
+
+  /**
+   * @brief Find the next occurrence of a byte with memchr on the contiguous
+   * parts of the storage
+   * @param value The byte to search for
+   * @param from Position to start the search
+   * @return Position of the byte or the file size if not found
+   */
+  size_t scanFor(char value, size_t from) {
+    size_t pos = from;
+    while (pos < data_ptr->size()) {
+      size_t count = data_ptr->size() - pos;
+      const uint8_t* ptr = bulkPointer(*data_ptr, pos, count);
+      if (ptr == nullptr) break;
+      const void* hit = memchr(ptr, static_cast<uint8_t>(value), count);
+      if (hit != nullptr) {
+        return pos + (static_cast<const uint8_t*>(hit) - ptr);
+      }
+      pos += count;
+    }
+    return data_ptr->size();
+  }
 
-  // Single callback for getting the next file
-  NextFileCallback nextFileCallback = nullptr;
+  /**
+   * @brief Compare the content at a position with a sequence
+   */
+  bool matchesAt(size_t pos, const uint8_t* target, size_t length) {
+    uint8_t buffer[32];
+    while (length > 0) {
+      size_t n = min(length, sizeof(buffer));
+      if (bulkRead(*data_ptr, pos, buffer, n) != n) return false;
+      if (memcmp(buffer, target, n) != 0) return false;
+      pos += n;
+      target += n;
+      length -= n;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Get a single byte
+   */
+  uint8_t byteAt(size_t pos) {
+    uint8_t value = 0;
+    bulkRead(*data_ptr, pos, &value, 1);
+    return value;
+  }
+
+  /**
+   * @brief Read the data from the current position up to a position into a
+   * String
+   */
+  String readStringTo(size_t end) {
+    String result;
+    if (end <= position_) return result;
+    result.reserve(end - position_);
+    while (position_ < end) {
+      size_t count = end - position_;
+      const uint8_t* ptr = bulkPointer(*data_ptr, position_, count);
+      if (ptr == nullptr) break;
+      result.concat(reinterpret_cast<const char*>(ptr), count);
+      position_ += count;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Write at a position (at most the file size): existing bytes are
+   * overwritten and the rest is appended, both with memcpy sized copies
+   * @param pos Position in the file
+   * @param buffer Data to write
+   * @param size Number of bytes
+   * @return Number of bytes written
+   */
+  size_t writeAt(size_t pos, const uint8_t* buffer, size_t size) {
+    size_t replaced = bulkWrite(*data_ptr, pos, buffer, size);
+    size_t appended = 0;
+    if (replaced < size) {
+      appended = bulkAppend(*data_ptr, buffer + replaced, size - replaced);
+    }
+    return replaced + appended;
+  }
+
+  /**
+   * @brief Shared storage of files which don't need their own storage yet
+   * (never written: files which are not open or only open for reading)
+   */
+  static Body& emptyBody() {
+    static Body empty;
+    return empty;
+  }
+
+  RWLock& bodyLock() const { return body ? body->lock : emptyBody().lock; }
+
+  EntryPtr nextEntry(const EntryPtr& entry) const {
+    RWLock::ReadGuard guard(*tree_lock);
+    Entry* next = Tree::next(entry.get());
+    return next != nullptr ? next->shared_from_this() : EntryPtr();
+  }
+
+  EntryPtr firstEntry(const EntryPtr& dir) const {
+    RWLock::ReadGuard guard(*tree_lock);
+    Entry* first = Tree::first(dir.get());
+    return first != nullptr ? first->shared_from_this() : EntryPtr();
+  }
 
   // Tags for debug logging
   static constexpr const char* TAG = "InMemoryFile";
 };
 
-// Type aliases for convenience
-using FilePSRAM = InMemoryFile<VectorPSRAM<uint8_t>>;
-using FileHIMEM = InMemoryFile<VectorHIMEM<uint8_t>>;
+// Type aliases for convenience: the files are stored in pages, so that
+// appending, truncating and overwriting never copy the whole file
+using FilePSRAM = InMemoryFile<PagedVectorPSRAM>;
+using FileHIMEM = InMemoryFile<PagedVectorHIMEM>;
 
 }  // namespace esp32_psram
\ No newline at end of file
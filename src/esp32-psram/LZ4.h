@@ -0,0 +1,189 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace esp32_psram {
+
+/**
+ * @brief Compression of single blocks in the LZ4 block format
+ *
+ * The output can be decoded by any LZ4 block decoder (LZ4_decompress_safe).
+ * The compressor is the greedy single pass of LZ4 with a small hash table,
+ * which favours speed over ratio. Blocks are limited to 64K, so that the
+ * positions in the hash table fit into 16 bits.
+ */
+namespace lz4 {
+constexpr size_t kMaxBlockSize = 65536;
+constexpr size_t kHashBits = 12;
+/// Number of entries of the hash table which is passed to compress()
+constexpr size_t kHashTableSize = size_t(1) << kHashBits;
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;  // the block always ends with literals
+constexpr size_t kMatchStartLimit = 12;  // no match starts in the last bytes
+
+/**
+ * @brief Get the maximum size of a compressed block
+ * @param len Size of the uncompressed block
+ * @return Size of the compressed block in the worst case
+ */
+inline size_t compressBound(size_t len) { return len + len / 255 + 16; }
+
+inline uint32_t read32(const uint8_t* ptr) {
+  uint32_t value;
+  memcpy(&value, ptr, sizeof(value));
+  return value;
+}
+
+inline uint32_t hash(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+/**
+ * @brief Write a length which did not fit into the 4 bits of the token
+ * @return Position after the length or nullptr if the output is full
+ */
+inline uint8_t* writeLength(uint8_t* op, uint8_t* end, size_t len) {
+  for (; len >= 255; len -= 255) {
+    if (op >= end) return nullptr;
+    *op++ = 255;
+  }
+  if (op >= end) return nullptr;
+  *op++ = (uint8_t)len;
+  return op;
+}
+
+/**
+ * @brief Write a sequence of literals and an optional match
+ * @return Position after the sequence or nullptr if the output is full
+ */
+inline uint8_t* writeSequence(uint8_t* op, uint8_t* end,
+                              const uint8_t* literals, size_t literalLen,
+                              size_t offset, size_t matchLen) {
+  if (op >= end) return nullptr;
+  uint8_t* token = op++;
+  *token = (uint8_t)(std::min<size_t>(literalLen, 15) << 4);
+  if (literalLen >= 15) {
+    op = writeLength(op, end, literalLen - 15);
+    if (op == nullptr) return nullptr;
+  }
+  if ((size_t)(end - op) < literalLen) return nullptr;
+  if (literalLen > 0) memcpy(op, literals, literalLen);
+  op += literalLen;
+  if (offset == 0) return op;  // last sequence: literals only
+  if (end - op < 2) return nullptr;
+  *op++ = offset & 0xFF;
+  *op++ = offset >> 8;
+  size_t len = matchLen - kMinMatch;
+  *token |= (uint8_t)std::min<size_t>(len, 15);
+  if (len >= 15) op = writeLength(op, end, len - 15);
+  return op;
+}
+
+/**
+ * @brief Compress a block
+ * @param src The data (at most kMaxBlockSize bytes)
+ * @param len Number of bytes
+ * @param dst Destination buffer
+ * @param capacity Size of the destination buffer
+ * @param table Hash table with kHashTableSize entries (the content is
+ * overwritten)
+ * @return Size of the compressed block, 0 if it does not fit into the
+ * destination buffer
+ */
+inline size_t compress(const uint8_t* src, size_t len, uint8_t* dst,
+                       size_t capacity, uint16_t* table) {
+  if (len > kMaxBlockSize) return 0;
+  uint8_t* op = dst;
+  uint8_t* end = dst + capacity;
+  const uint8_t* anchor = src;
+  if (len > kMatchStartLimit) {
+    memset(table, 0, kHashTableSize * sizeof(uint16_t));
+    const uint8_t* ip = src + 1;
+    const uint8_t* matchStartLimit = src + len - kMatchStartLimit;
+    const uint8_t* matchLimit = src + len - kLastLiterals;
+    while (ip < matchStartLimit) {
+      uint32_t sequence = read32(ip);
+      uint16_t* slot = &table[hash(sequence)];
+      const uint8_t* ref = src + *slot;
+      *slot = (uint16_t)(ip - src);
+      if (ref >= ip || ip - ref > 0xFFFF || read32(ref) != sequence) {
+        // skip faster through data which does not compress
+        ip += 1 + ((ip - anchor) >> 6);
+        continue;
+      }
+      const uint8_t* mp = ip + kMinMatch;
+      const uint8_t* rp = ref + kMinMatch;
+      while (mp < matchLimit && *mp == *rp) {
+        mp++;
+        rp++;
+      }
+      op = writeSequence(op, end, anchor, ip - anchor, ip - ref, mp - ip);
+      if (op == nullptr) return 0;
+      ip = anchor = mp;
+    }
+  }
+  op = writeSequence(op, end, anchor, src + len - anchor, 0, 0);
+  return op == nullptr ? 0 : op - dst;
+}
+
+/**
+ * @brief Decompress a block
+ * @param src The compressed block
+ * @param len Size of the compressed block
+ * @param dst Destination buffer
+ * @param capacity Size of the destination buffer
+ * @return Size of the decompressed data, SIZE_MAX if the block is invalid
+ * or does not fit into the destination buffer
+ */
+inline size_t decompress(const uint8_t* src, size_t len, uint8_t* dst,
+                         size_t capacity) {
+  const uint8_t* ip = src;
+  const uint8_t* iend = src + len;
+  uint8_t* op = dst;
+  uint8_t* oend = dst + capacity;
+  auto readLength = [&](size_t& value) {
+    uint8_t b;
+    do {
+      if (ip >= iend) return false;
+      b = *ip++;
+      value += b;
+    } while (b == 255);
+    return true;
+  };
+  while (ip < iend) {
+    uint8_t token = *ip++;
+    size_t literals = token >> 4;
+    if (literals == 15 && !readLength(literals)) return SIZE_MAX;
+    if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) {
+      return SIZE_MAX;
+    }
+    memcpy(op, ip, literals);
+    op += literals;
+    ip += literals;
+    if (ip >= iend) break;  // the last sequence has no match
+
+    if (iend - ip < 2) return SIZE_MAX;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > (size_t)(op - dst)) return SIZE_MAX;
+    size_t matchLen = token & 15;
+    if (matchLen == 15 && !readLength(matchLen)) return SIZE_MAX;
+    matchLen += kMinMatch;
+    if (matchLen > (size_t)(oend - op)) return SIZE_MAX;
+    const uint8_t* match = op - offset;
+    if (offset >= matchLen) {
+      memcpy(op, match, matchLen);
+      op += matchLen;
+    } else {
+      // overlapping match: repeats the last offset bytes
+      for (size_t j = 0; j < matchLen; j++) *op++ = *match++;
+    }
+  }
+  return op - dst;
+}
+}  // namespace lz4
+
+}  // namespace esp32_psram
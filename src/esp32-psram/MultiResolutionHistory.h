@@ -0,0 +1,276 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <initializer_list>
+#include <vector>
+
+#include "TypedRingBuffer.h"
+
+namespace esp32_psram {
+
+/**
+ * @struct HistoryAggregate
+ * @brief Summary of a block of samples: minimum, maximum, mean and last value
+ * @tparam T The (numeric) sample type
+ */
+template <typename T>
+struct HistoryAggregate {
+  T minimum{};
+  T maximum{};
+  double mean = 0.0;
+  T last{};
+  /// Number of raw samples which are summarized
+  uint32_t count = 0;
+
+  /**
+   * @brief Create the aggregate of a single sample
+   * @param value The sample
+   * @return Aggregate with count 1
+   */
+  static HistoryAggregate of(const T& value) {
+    HistoryAggregate result;
+    result.minimum = result.maximum = result.last = value;
+    result.mean = static_cast<double>(value);
+    result.count = 1;
+    return result;
+  }
+
+  /**
+   * @brief Add a later block to this aggregate
+   * @param other The aggregate of the following samples
+   */
+  void merge(const HistoryAggregate& other) {
+    if (other.count == 0) return;
+    if (count == 0) {
+      *this = other;
+      return;
+    }
+    if (other.minimum < minimum) minimum = other.minimum;
+    if (maximum < other.maximum) maximum = other.maximum;
+    uint32_t total = count + other.count;
+    mean += (other.mean - mean) * other.count / total;
+    last = other.last;
+    count = total;
+  }
+};
+
+/**
+ * @struct HistoryTier
+ * @brief Configuration of one resolution of a MultiResolutionHistory
+ */
+struct HistoryTier {
+  /// Number of entries which are kept in this tier
+  size_t capacity;
+  /// Number of entries of the next finer tier which make up one entry
+  /// (ignored for the first tier which records the individual samples)
+  size_t factor;
+};
+
+/**
+ * @class MultiResolutionHistory
+ * @brief Cascade of ring buffers which keep a history in several resolutions
+ * @tparam T The (numeric) sample type
+ * @tparam VectorType The vector type which stores the aggregates
+ *
+ * The first tier records every sample, each following tier records one
+ * aggregate (min/max/mean/last) for a block of `factor` entries of the tier
+ * before it. E.g. one sample per second with the tiers
+ * {{60, 1}, {60, 60}, {24, 60}} keeps the last minute per second, the last
+ * hour per minute and the last day per hour.
+ *
+ * Each tier is a TypedRingBuffer of fixed capacity which overwrites its
+ * oldest entries, so the memory budget is fixed at construction. The blocks
+ * are accumulated incrementally while the samples arrive, so adding a sample
+ * never reads back from the (PSRAM or HIMEM) storage.
+ */
+template <typename T, typename VectorType>
+class MultiResolutionHistory {
+ public:
+  using Aggregate = HistoryAggregate<T>;
+  using Ring = TypedRingBuffer<Aggregate, VectorType>;
+
+  /**
+   * @brief Constructor
+   * @param tiers The resolutions, from the finest to the coarsest
+   */
+  MultiResolutionHistory(std::initializer_list<HistoryTier> tiers)
+      : MultiResolutionHistory(std::vector<HistoryTier>(tiers)) {}
+
+  /**
+   * @brief Constructor
+   * @param tiers The resolutions, from the finest to the coarsest; a
+   * capacity of 0 is replaced by 1
+   */
+  MultiResolutionHistory(const std::vector<HistoryTier>& tiers) {
+    levels.reserve(tiers.size());
+    for (size_t j = 0; j < tiers.size(); j++) {
+      size_t factor = j == 0 || tiers[j].factor == 0 ? 1 : tiers[j].factor;
+      size_t capacity = tiers[j].capacity;
+      if (capacity == 0) {
+        // a ring buffer needs at least one entry
+        ESP_LOGE(TAG, "tier %u: capacity 0 is invalid, using 1", (unsigned)j);
+        capacity = 1;
+      }
+      levels.emplace_back(capacity, factor);
+    }
+  }
+
+  /**
+   * @brief Record a sample and update the coarser tiers
+   * @param value The sample
+   */
+  void add(const T& value) { record(0, Aggregate::of(value)); }
+
+  /**
+   * @brief Remove all entries from all tiers
+   */
+  void clear() {
+    for (Level& level : levels) {
+      level.ring.clear();
+      level.pending = Aggregate();
+      level.pendingEntries = 0;
+    }
+  }
+
+  /**
+   * @brief Get the number of tiers
+   * @return Number of resolutions
+   */
+  size_t tierCount() const { return levels.size(); }
+
+  /**
+   * @brief Get the number of raw samples which make up one entry of a tier
+   * @param tier Tier index (0 = finest)
+   * @return Samples per entry
+   */
+  size_t samplesPerEntry(size_t tier) const {
+    size_t result = 1;
+    for (size_t j = 1; j <= tier && j < levels.size(); j++) {
+      result *= levels[j].factor;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Get the number of entries in a tier
+   * @param tier Tier index (0 = finest)
+   * @return Number of entries
+   */
+  size_t size(size_t tier) const {
+    return tier < levels.size() ? levels[tier].ring.available() : 0;
+  }
+
+  /**
+   * @brief Get an entry of a tier
+   * @param tier Tier index (0 = finest)
+   * @param index Entry index (0 = oldest)
+   * @param result The entry
+   * @return true if the entry exists
+   */
+  bool get(size_t tier, size_t index, Aggregate& result) const {
+    if (tier >= levels.size()) return false;
+    return levels[tier].ring.peekAt(index, result);
+  }
+
+  /**
+   * @brief Get the most recent entry of a tier
+   * @param tier Tier index (0 = finest)
+   * @param result The entry
+   * @return true if the tier is not empty
+   */
+  bool latest(size_t tier, Aggregate& result) const {
+    size_t n = size(tier);
+    return n > 0 && get(tier, n - 1, result);
+  }
+
+  /**
+   * @brief Get the aggregate of the incomplete block of a tier
+   * @param tier Tier index (1 = block which is collected for the second tier)
+   * @return Aggregate of the samples which are not yet part of an entry of
+   * this tier (count = 0 if there are none)
+   */
+  Aggregate pending(size_t tier) const {
+    return tier < levels.size() ? levels[tier].pending : Aggregate();
+  }
+
+  /**
+   * @brief Combine the most recent entries of a tier
+   * @param tier Tier index (0 = finest)
+   * @param count Number of entries (limited by the available entries)
+   * @return Aggregate over the entries
+   */
+  Aggregate summary(size_t tier, size_t count = SIZE_MAX) const {
+    Aggregate result;
+    size_t n = size(tier);
+    if (count > n) count = n;
+    for (size_t j = n - count; j < n; j++) {
+      Aggregate entry;
+      if (get(tier, j, entry)) result.merge(entry);
+    }
+    return result;
+  }
+
+  /**
+   * @brief Direct access to the ring buffer of a tier, e.g. for iterators
+   * @param tier Tier index (0 = finest), must be smaller than tierCount()
+   * @return The ring buffer, oldest entry first
+   */
+  const Ring& tier(size_t tier) const { return levels[tier].ring; }
+
+ protected:
+  struct Level {
+    Level(size_t capacity, size_t factor) : ring(capacity), factor(factor) {}
+    Ring ring;
+    size_t factor;
+    Aggregate pending;
+    size_t pendingEntries = 0;
+  };
+  std::vector<Level> levels;
+  static constexpr const char* TAG = "MultiResolutionHistory";
+
+  /**
+   * @brief Add an entry to a tier and forward completed blocks to the
+   * coarser tiers
+   * @param tier Tier index
+   * @param entry The entry
+   */
+  void record(size_t tier, Aggregate entry) {
+    for (; tier < levels.size(); tier++) {
+      levels[tier].ring.pushOverwrite(entry);
+      if (tier + 1 == levels.size()) return;
+
+      Level& next = levels[tier + 1];
+      next.pending.merge(entry);
+      if (++next.pendingEntries < next.factor) return;
+
+      // block complete: it becomes an entry of the next tier
+      entry = next.pending;
+      next.pending = Aggregate();
+      next.pendingEntries = 0;
+    }
+  }
+};
+
+/**
+ * @brief Type alias for a multi-resolution history in RAM
+ */
+template <typename T>
+using MultiResolutionHistoryRAM =
+    MultiResolutionHistory<T, std::vector<HistoryAggregate<T>>>;
+
+/**
+ * @brief Type alias for a multi-resolution history in PSRAM
+ */
+template <typename T>
+using MultiResolutionHistoryPSRAM =
+    MultiResolutionHistory<T, VectorPSRAM<HistoryAggregate<T>>>;
+
+/**
+ * @brief Type alias for a multi-resolution history in HIMEM
+ */
+template <typename T>
+using MultiResolutionHistoryHIMEM =
+    MultiResolutionHistory<T, VectorHIMEM<HistoryAggregate<T>>>;
+
+}  // namespace esp32_psram
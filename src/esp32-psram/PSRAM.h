@@ -2,7 +2,7 @@
 
 #include <Arduino.h>
 #include "InMemoryFS.h"
-#include "VectorPSRAM.h"
+#include "PagedVector.h"
 
 
 namespace esp32_psram {
@@ -14,7 +14,7 @@ namespace esp32_psram {
  * This class provides an interface similar to SD.h for managing files
  * that are stored in PSRAM memory rather than on an SD card.
  */
-class PSRAMClass : public InMemoryFS<VectorPSRAM<uint8_t>, FilePSRAM> {
+class PSRAMClass : public InMemoryFS<PagedVectorPSRAM, FilePSRAM> {
 public:
     /**
      * @brief Initialize the PSRAM filesystem
@@ -30,19 +30,20 @@ public:
     }
 
     /**
-     * @brief Get total space (returns available PSRAM)
+     * @brief Get total space (returns available PSRAM, limited by the quota)
      * @return Total PSRAM size in bytes
      */
     uint64_t totalBytes() override {
-        return ESP.getPsramSize();
+        return limitTotal(ESP.getPsramSize());
     }
 
     /**
-     * @brief Get free space (returns free PSRAM)
+     * @brief Get free space (returns free PSRAM, limited by what is left of
+     * the quota)
      * @return Free PSRAM size in bytes
      */
     uint64_t freeBytes() override {
-        return ESP.getFreePsram();
+        return limitFree(ESP.getFreePsram());
     }
 };
 
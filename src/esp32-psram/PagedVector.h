@@ -0,0 +1,564 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "AllocatorPSRAM.h"
+#include "SpaceAccount.h"
+#include "VectorAccess.h"
+#include "VectorHIMEM.h"
+#include "VectorPSRAM.h"
+
+namespace esp32_psram {
+
+/**
+ * @class PagedVector
+ * @brief Vector-like storage made of fixed-size pages
+ * @tparam T Type of the elements (plain data)
+ * @tparam PageVector The vector type of a single page, which defines where
+ * the memory comes from (VectorPSRAM or VectorHIMEM)
+ * @tparam PageElements Number of elements per page
+ *
+ * Unlike a single vector, the content is never moved as a whole: growing
+ * allocates new pages at the end, shrinking frees the pages at the end and
+ * writing only touches the pages of the written range. So the cost of file
+ * operations is proportional to the number of bytes touched and not to the
+ * file size.
+ *
+ * The page table is kept in PSRAM. For HIMEM pages only the page which was
+ * accessed last keeps its window mapped, because the number of map ranges is
+ * limited.
+ *
+ * Optionally the allocated pages and the page table are charged to a
+ * SpaceAccount: a page which does not fit into its quota is not allocated.
+ *
+ * Copies share the pages with reference counting (copy on write): a page is
+ * only duplicated when one of the vectors writes to it, so copying a large
+ * vector is cheap. Each page is charged once, to the account of the vector
+ * which allocated it. HIMEM pages are not shared, because the mapped window
+ * belongs to the page: copies of PagedVectorHIMEM duplicate all pages.
+ *
+ * The bulk access functions (bulkRead(), bulkWrite(), bulkAppend(),
+ * bulkPointer()) are provided for this class, so it can be used as storage of
+ * InMemoryFile.
+ */
+template <typename T, typename PageVector, size_t PageElements>
+class PagedVector {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+
+  PagedVector() = default;
+  PagedVector(const PagedVector& other) { *this = other; }
+  PagedVector(PagedVector&& other) noexcept { swap(other); }
+  ~PagedVector() {
+    clear();
+    if (account != nullptr) account->release(charged);
+  }
+
+  PagedVector& operator=(const PagedVector& other) {
+    if (this != &other) {
+      clear();
+      if (SharedReadAccess<PageVector>::value) {
+        if (!reserveTable(other.pages.size())) return *this;
+        for (const PagePtr& page : other.pages) pages.push_back(page);
+        element_count = other.element_count;
+        settle();
+        return *this;
+      }
+      if (!reserve(other.element_count)) return *this;
+      // copy window by window, so at most two HIMEM windows are mapped
+      PagedVector& source = const_cast<PagedVector&>(other);
+      size_t pos = 0;
+      while (pos < other.element_count) {
+        size_t count = other.element_count - pos;
+        const T* ptr = source.window(pos, count);
+        if (ptr == nullptr || write(ptr, pos, count, true) != count) break;
+        pos += count;
+      }
+      source.unmap();
+      unmap();
+    }
+    return *this;
+  }
+
+  PagedVector& operator=(PagedVector&& other) noexcept {
+    if (this != &other) {
+      clear();
+      swap(other);
+    }
+    return *this;
+  }
+
+  /**
+   * @brief Get the number of elements
+   * @return Number of elements
+   */
+  size_t size() const { return element_count; }
+
+  /**
+   * @brief Check if the vector is empty
+   * @return true if there are no elements
+   */
+  bool empty() const { return element_count == 0; }
+
+  /**
+   * @brief Get the number of elements which fit into the allocated pages
+   * @return Capacity in elements
+   */
+  size_t capacity() const { return pages.size() * PageElements; }
+
+  /**
+   * @brief Get the number of elements per page
+   * @return Page size in elements
+   */
+  static constexpr size_t pageSize() { return PageElements; }
+
+  /**
+   * @brief Get the number of allocated pages
+   * @return Number of pages
+   */
+  size_t pageCount() const { return pages.size(); }
+
+  /**
+   * @brief Allocate pages so that the indicated number of elements fit
+   * @param new_cap The requested capacity in elements
+   * @return true if the pages could be allocated
+   */
+  bool reserve(size_t new_cap) {
+    size_t required = (new_cap + PageElements - 1) / PageElements;
+    if (!reserveTable(required)) return false;
+    while (pages.size() < required) {
+      PagePtr page = newPage();
+      if (!page) return false;
+      pages.push_back(std::move(page));
+      releasePreviousWindow(pages.size() - 1);
+    }
+    return true;
+  }
+
+  /**
+   * @brief Change the number of elements: new elements are zeroed and the
+   * pages after the new end are freed
+   * @param count The new size
+   */
+  void resize(size_t count) {
+    if (count > element_count) {
+      if (!reserve(count)) return;
+      T zeros[64] = {};
+      while (element_count < count) {
+        size_t n = std::min(count - element_count, sizeof(zeros) / sizeof(T));
+        // a page which can't be copied or mapped: size() shows the failure
+        if (write(zeros, element_count, n, true) == 0) break;
+      }
+    } else {
+      element_count = count;
+      shrinkPages();
+    }
+  }
+
+  /**
+   * @brief Remove all elements and free all pages
+   */
+  void clear() {
+    element_count = 0;
+    shrinkPages();
+  }
+
+  /**
+   * @brief Add an element to the end
+   * @param value The value to append
+   */
+  void push_back(const T& value) { append(&value, 1); }
+
+  /**
+   * @brief Read access to an element
+   * @param pos Index of the element
+   * @return Copy of the element
+   */
+  T operator[](size_t pos) const {
+    T value{};
+    read(&value, pos, 1);
+    return value;
+  }
+
+  /**
+   * @brief Copy elements out of the pages
+   * @param dest Destination buffer
+   * @param pos Index of the first element
+   * @param count Number of elements
+   * @return Number of elements copied
+   */
+  size_t read(T* dest, size_t pos, size_t count) const {
+    if (pos >= element_count) return 0;
+    count = std::min(count, element_count - pos);
+    PagedVector& self = const_cast<PagedVector&>(*this);
+    size_t done = 0;
+    while (done < count) {
+      size_t offset = (pos + done) % PageElements;
+      size_t n = std::min(count - done, PageElements - offset);
+      size_t copied = bulkRead(self.page(pos + done), offset, dest + done, n);
+      done += copied;
+      if (copied < n) break;
+    }
+    return done;
+  }
+
+  /**
+   * @brief Overwrite existing elements
+   * @param src Source buffer
+   * @param pos Index of the first element
+   * @param count Number of elements (limited by size())
+   * @return Number of elements written
+   */
+  size_t write(const T* src, size_t pos, size_t count) {
+    return write(src, pos, count, false);
+  }
+
+  /**
+   * @brief Append elements, allocating new pages as needed
+   * @param src Source buffer
+   * @param count Number of elements
+   * @return Number of elements appended
+   */
+  size_t append(const T* src, size_t count) {
+    if (!reserve(element_count + count)) {
+      count = std::min(count, capacity() - element_count);
+    }
+    return write(src, element_count, count, true);
+  }
+
+  /**
+   * @brief Get direct access to the elements of one page
+   *
+   * For HIMEM the pointer is only valid until the next access. Call
+   * unshare() before writing via the pointer.
+   * @param pos Index of the first element
+   * @param count In: requested number of elements, Out: number of elements
+   * which are contiguously accessible via the returned pointer
+   * @return Pointer to the element at pos or nullptr
+   */
+  T* window(size_t pos, size_t& count) {
+    if (pos >= element_count) {
+      count = 0;
+      return nullptr;
+    }
+    size_t offset = pos % PageElements;
+    count = std::min(std::min(count, element_count - pos),
+                     PageElements - offset);
+    return bulkPointer(page(pos), offset, count);
+  }
+
+  /**
+   * @brief Give the pages of a range their own copy, so that they can be
+   * modified via window() without changing the vectors which share them
+   * @param pos Index of the first element
+   * @param count Number of elements
+   * @return true if successful, false if a page could not be copied
+   */
+  bool unshare(size_t pos, size_t count) {
+    if (pos >= element_count || count == 0) return true;
+    size_t last = (pos + std::min(count, element_count - pos) - 1) /
+                  PageElements;
+    for (size_t index = pos / PageElements; index <= last; index++) {
+      if (writablePage(index) == nullptr) return false;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Get the number of pages which are shared with other vectors
+   * @return Number of pages
+   */
+  size_t sharedPageCount() const {
+    size_t result = 0;
+    for (const PagePtr& page : pages) {
+      if (page.use_count() > 1) result++;
+    }
+    return result;
+  }
+
+  /**
+   * @brief Release the HIMEM window of the page which was accessed last, so
+   * that an idle vector does not hold one of the few map ranges
+   */
+  void unmap() {
+    if (SharedReadAccess<PageVector>::value) return;
+    if (mapped_page < pages.size()) releaseWindow(pages[mapped_page]->data);
+    mapped_page = SIZE_MAX;
+  }
+
+  /**
+   * @brief Swap the contents with another PagedVector
+   * @param other The other vector
+   */
+  void swap(PagedVector& other) noexcept {
+    std::swap(pages, other.pages);
+    std::swap(element_count, other.element_count);
+    std::swap(mapped_page, other.mapped_page);
+    // each side keeps its account, which is charged for the new content
+    settle();
+    other.settle();
+  }
+
+  /**
+   * @brief Charge the allocated memory to an account from now on
+   * @param newAccount The account, nullptr to stop charging
+   */
+  void setAccount(SpaceAccountPtr newAccount) {
+    if (account != nullptr) account->release(charged);
+    // move the pages which were charged by this vector
+    for (PagePtr& page : pages) {
+      if (page->account != account) continue;
+      if (account != nullptr) account->release(pageBytes());
+      if (newAccount != nullptr) newAccount->charge(pageBytes());
+      page->account = newAccount;
+    }
+    account = newAccount;
+    if (account != nullptr) account->charge(charged);
+  }
+
+  /**
+   * @brief Get the memory which is used by the pages and the page table
+   *
+   * Shared pages are included, so the sum over several vectors can be larger
+   * than the allocated memory.
+   * @return Size in bytes
+   */
+  size_t memoryUsage() const {
+    return pages.size() * pageBytes() + tableBytes();
+  }
+
+ protected:
+  /// Page which can be shared by several vectors
+  struct Page {
+    PageVector data;
+    SpaceAccountPtr account;  // charged for the page
+    ~Page() {
+      if (account != nullptr) account->release(pageBytes());
+    }
+  };
+  using PagePtr = std::shared_ptr<Page>;
+
+  VectorPSRAM<PagePtr> pages;
+  size_t element_count = 0;
+  size_t mapped_page = SIZE_MAX;
+  SpaceAccountPtr account;
+  size_t charged = 0;  // page table as charged to the account
+
+  static constexpr size_t pageBytes() { return PageElements * sizeof(T); }
+
+  size_t tableBytes() const { return pages.capacity() * sizeof(PagePtr); }
+
+  /**
+   * @brief Grow the page table explicitly, so that it is part of the quota
+   * @param required Number of pages
+   */
+  bool reserveTable(size_t required) {
+    if (pages.capacity() >= required) return true;
+    size_t table = std::max(required, 2 * pages.capacity());
+    size_t bytes = (table - pages.capacity()) * sizeof(PagePtr);
+    if (account != nullptr && !account->allocate(bytes)) {
+      ESP_LOGW(TAG, "PagedVector: quota exceeded");
+      return false;
+    }
+    charged += bytes;
+    pages.reserve(table);
+    settle();
+    return true;
+  }
+
+  /**
+   * @brief Allocate a page and charge it to the account
+   * @return The page or nullptr
+   */
+  PagePtr newPage() {
+    if (account != nullptr && !account->allocate(pageBytes())) {
+      ESP_LOGW(TAG, "PagedVector: quota exceeded");
+      return nullptr;
+    }
+    PagePtr page = std::allocate_shared<Page>(AllocatorPSRAM<Page>());
+    if (page) page->data.resize(PageElements);
+    if (!page || page->data.size() != PageElements) {
+      ESP_LOGE(TAG, "PagedVector: page allocation failed");
+      if (account != nullptr) account->release(pageBytes());
+      return nullptr;
+    }
+    page->account = account;
+    return page;
+  }
+
+  /**
+   * @brief Update the account after the page table was resized
+   */
+  void settle() {
+    size_t usage = tableBytes();
+    if (account != nullptr) {
+      if (usage > charged) {
+        account->charge(usage - charged);
+      } else {
+        account->release(charged - usage);
+      }
+    }
+    charged = usage;
+  }
+
+  /**
+   * @brief Get the page which contains an element, releasing the window of
+   * the page which was accessed before
+   * @param pos Index of the element
+   * @return The page
+   */
+  PageVector& page(size_t pos) {
+    size_t index = pos / PageElements;
+    releasePreviousWindow(index);
+    return pages[index]->data;
+  }
+
+  /**
+   * @brief Get a page for writing: a page which is shared with other vectors
+   * is replaced by a copy first
+   * @param index Index of the page
+   * @return The page or nullptr if the copy could not be allocated
+   */
+  PageVector* writablePage(size_t index) {
+    releasePreviousWindow(index);
+    PagePtr& page = pages[index];
+    if (page.use_count() == 1) {
+      // the other owners released the page: see their last writes
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return &page->data;
+    }
+    PagePtr copy = newPage();
+    if (!copy) return nullptr;
+    size_t count = PageElements;
+    const T* src = bulkPointer(page->data, 0, count);
+    bulkWrite(copy->data, 0, src, count);
+    page = std::move(copy);
+    return &page->data;
+  }
+
+  /**
+   * @brief Remember the page which is accessed and release the window of the
+   * page which was accessed before
+   */
+  void releasePreviousWindow(size_t index) {
+    // pages with contiguous storage are never mapped: don't modify any state,
+    // so that the pages can be read in parallel
+    if (SharedReadAccess<PageVector>::value) return;
+    if (mapped_page != index && mapped_page < pages.size()) {
+      releaseWindow(pages[mapped_page]->data);
+    }
+    mapped_page = index;
+  }
+
+  /**
+   * @brief Write into the allocated pages
+   * @param extend true to allow writing past the end (within the capacity)
+   */
+  size_t write(const T* src, size_t pos, size_t count, bool extend) {
+    size_t limit = extend ? capacity() : element_count;
+    if (pos > element_count || pos >= limit) return 0;
+    count = std::min(count, limit - pos);
+    size_t done = 0;
+    while (done < count) {
+      size_t offset = (pos + done) % PageElements;
+      size_t n = std::min(count - done, PageElements - offset);
+      PageVector* target = writablePage((pos + done) / PageElements);
+      if (target == nullptr) break;
+      size_t copied = bulkWrite(*target, offset, src + done, n);
+      done += copied;
+      if (copied < n) break;
+    }
+    element_count = std::max(element_count, pos + done);
+    return done;
+  }
+
+  /**
+   * @brief Free the pages after the last element
+   */
+  void shrinkPages() {
+    size_t required = (element_count + PageElements - 1) / PageElements;
+    if (mapped_page >= required) mapped_page = SIZE_MAX;
+    while (pages.size() > required) pages.pop_back();
+    settle();
+  }
+};
+
+/**
+ * @brief A PagedVector can be read in parallel if its pages can
+ */
+template <typename T, typename PageVector, size_t PageElements>
+struct SharedReadAccess<PagedVector<T, PageVector, PageElements>>
+    : SharedReadAccess<PageVector> {};
+
+/**
+ * @brief Copy elements out of a PagedVector
+ */
+template <typename T, typename PageVector, size_t PageElements>
+size_t bulkRead(const PagedVector<T, PageVector, PageElements>& vec,
+                size_t pos, T* dest, size_t count) {
+  return vec.read(dest, pos, count);
+}
+
+/**
+ * @brief Overwrite elements of a PagedVector
+ */
+template <typename T, typename PageVector, size_t PageElements>
+size_t bulkWrite(PagedVector<T, PageVector, PageElements>& vec, size_t pos,
+                 const T* src, size_t count) {
+  return vec.write(src, pos, count);
+}
+
+/**
+ * @brief Append elements to a PagedVector
+ */
+template <typename T, typename PageVector, size_t PageElements>
+size_t bulkAppend(PagedVector<T, PageVector, PageElements>& vec, const T* src,
+                  size_t count) {
+  return vec.append(src, count);
+}
+
+/**
+ * @brief Get a pointer to the elements of one page of a PagedVector
+ *
+ * Call makeWritable() before writing via the pointer.
+ */
+template <typename T, typename PageVector, size_t PageElements>
+T* bulkPointer(PagedVector<T, PageVector, PageElements>& vec, size_t pos,
+               size_t& count) {
+  return vec.window(pos, count);
+}
+
+/**
+ * @brief Copy the shared pages of a range of a PagedVector
+ */
+template <typename T, typename PageVector, size_t PageElements>
+bool makeWritable(PagedVector<T, PageVector, PageElements>& vec, size_t pos,
+                  size_t count) {
+  return vec.unshare(pos, count);
+}
+
+/**
+ * @brief Release the HIMEM window of a PagedVector
+ */
+template <typename T, typename PageVector, size_t PageElements>
+void releaseWindow(PagedVector<T, PageVector, PageElements>& vec) {
+  vec.unmap();
+}
+
+/**
+ * @brief Paged byte storage in PSRAM with 4K pages
+ */
+using PagedVectorPSRAM = PagedVector<uint8_t, VectorPSRAM<uint8_t>, 4096>;
+
+/**
+ * @brief Paged byte storage in HIMEM with pages of one 32K HIMEM block
+ */
+using PagedVectorHIMEM =
+    PagedVector<uint8_t, VectorHIMEM<uint8_t>, ESP_HIMEM_BLKSZ>;
+
+}  // namespace esp32_psram
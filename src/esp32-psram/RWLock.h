@@ -0,0 +1,120 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+namespace esp32_psram {
+
+/**
+ * @class RWLock
+ * @brief Lightweight reader-writer lock based on a single atomic counter
+ *
+ * Any number of readers can hold the lock at the same time, a writer holds
+ * it exclusively. Taking a read lock while no writer is active is a single
+ * compare-and-swap, so parallel readers don't block each other.
+ *
+ * Readers are preferred: a reader can enter while other readers are active,
+ * so read locks can be nested. Waiting tasks spin briefly and then sleep for
+ * a tick, so that a lower priority task which holds the lock can continue.
+ */
+class RWLock {
+ public:
+  RWLock() = default;
+  RWLock(const RWLock&) = delete;
+  RWLock& operator=(const RWLock&) = delete;
+
+  /**
+   * @brief Acquire the lock for reading
+   */
+  void lockShared() {
+    int spins = 0;
+    int32_t current = state.load(std::memory_order_relaxed);
+    while (true) {
+      if (current >= 0 &&
+          state.compare_exchange_weak(current, current + 1,
+                                      std::memory_order_acquire,
+                                      std::memory_order_relaxed)) {
+        return;
+      }
+      if (current < 0) {
+        backoff(spins);
+        current = state.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /**
+   * @brief Release a read lock
+   */
+  void unlockShared() { state.fetch_sub(1, std::memory_order_release); }
+
+  /**
+   * @brief Acquire the lock for writing
+   */
+  void lock() {
+    int spins = 0;
+    int32_t expected = 0;
+    while (!state.compare_exchange_weak(expected, kWriter,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+      expected = 0;
+      backoff(spins);
+    }
+  }
+
+  /**
+   * @brief Release the write lock
+   */
+  void unlock() { state.store(0, std::memory_order_release); }
+
+  /**
+   * @brief Get the number of active readers
+   * @return Number of readers, -1 if a writer holds the lock
+   */
+  int32_t readers() const { return state.load(std::memory_order_relaxed); }
+
+  /**
+   * @class ReadGuard
+   * @brief Holds a read lock for the lifetime of the object
+   */
+  class ReadGuard {
+   public:
+    explicit ReadGuard(RWLock& lock) : lock(lock) { lock.lockShared(); }
+    ~ReadGuard() { lock.unlockShared(); }
+    ReadGuard(const ReadGuard&) = delete;
+    ReadGuard& operator=(const ReadGuard&) = delete;
+
+   private:
+    RWLock& lock;
+  };
+
+  /**
+   * @class WriteGuard
+   * @brief Holds the write lock for the lifetime of the object
+   */
+  class WriteGuard {
+   public:
+    explicit WriteGuard(RWLock& lock) : lock(lock) { lock.lock(); }
+    ~WriteGuard() { lock.unlock(); }
+    WriteGuard(const WriteGuard&) = delete;
+    WriteGuard& operator=(const WriteGuard&) = delete;
+
+   private:
+    RWLock& lock;
+  };
+
+ protected:
+  static constexpr int32_t kWriter = -1;
+  std::atomic<int32_t> state{0};
+
+  static void backoff(int& spins) {
+    if (++spins < 16) {
+      yield();
+    } else {
+      delay(1);
+    }
+  }
+};
+
+}  // namespace esp32_psram
@@ -2,8 +2,12 @@
 
 #include <Arduino.h>
 #include <Stream.h>
+#include <functional>
 #include "VectorPSRAM.h"
 #include "VectorHIMEM.h"
+#include "VectorAccess.h"
+#include "RingIterator.h"
+#include "Span.h"
 
 namespace esp32_psram {
 
@@ -15,15 +19,46 @@ namespace esp32_psram {
  * This class implements a ring buffer (circular buffer) that uses a vector container
  * for storage. It extends Arduino's Stream class to provide standard stream functionality.
  * The buffer can be used with any vector type, including VectorPSRAM and VectorHIMEM.
+ *
+ * Producers and consumers can register high and low watermark callbacks, so that
+ * they are notified when the fill level crosses a threshold instead of polling
+ * available() and availableForWrite().
+ *
+ * In addition to the byte oriented Stream API the buffer supports a framed
+ * message mode (writeMessage(), readMessage(), peekMessage()) which stores
+ * length prefixed messages that are always contiguous in memory. The two modes
+ * must not be mixed on the same buffer.
+ *
+ * The buffered data can be inspected without consuming it with the
+ * begin()/end() iterators or, for RAM and PSRAM storage, with the (up to)
+ * two contiguous spans returned by segments().
  */
 template <typename VectorType>
 class RingBufferStream : public Stream {
+public:
+    /**
+     * @brief Callback which is called when a watermark is crossed
+     */
+    using WatermarkCallback = std::function<void(RingBufferStream<VectorType>&)>;
+
+    /**
+     * @brief Random access iterator over the buffered bytes, oldest first
+     *
+     * The iterator is invalidated when data is read from the buffer.
+     */
+    using const_iterator = RingIterator<RingBufferStream, uint8_t, uint8_t>;
+    using iterator = const_iterator;
+
 private:
     VectorType buffer;
     size_t readIndex = 0;
     size_t writeIndex = 0;
     bool full = false;
     size_t maxSize;
+    size_t highWatermark = 0;
+    size_t lowWatermark = 0;
+    WatermarkCallback highWatermarkCallback = nullptr;
+    WatermarkCallback lowWatermarkCallback = nullptr;
 
 public:
     /**
@@ -39,14 +74,7 @@ public:
      * @return Number of bytes available
      */
     int available() override {
-        if (full) {
-            return maxSize;
-        }
-        if (writeIndex >= readIndex) {
-            return writeIndex - readIndex;
-        } else {
-            return maxSize - (readIndex - writeIndex);
-        }
+        return usedBytes();
     }
 
     /**
@@ -54,13 +82,11 @@ public:
      * @return The byte read, or -1 if the buffer is empty
      */
     int read() override {
-        if (isEmpty()) {
-            return -1;
+        size_t before = usedBytes();
+        int value = readByte();
+        if (value >= 0) {
+            notifyAfterRead(before);
         }
-
-        uint8_t value = buffer[readIndex];
-        readIndex = (readIndex + 1) % maxSize;
-        full = false;
         return value;
     }
 
@@ -73,7 +99,9 @@ public:
             return -1;
         }
 
-        return buffer[readIndex];
+        uint8_t value = 0;
+        bulkRead(buffer, readIndex, &value, 1);
+        return value;
     }
 
     /**
@@ -82,18 +110,11 @@ public:
      * @return 1 if the byte was written, 0 if the buffer is full
      */
     size_t write(uint8_t value) override {
-        if (full) {
+        size_t before = usedBytes();
+        if (!writeByte(value)) {
             return 0;
         }
-
-        buffer[writeIndex] = value;
-        writeIndex = (writeIndex + 1) % maxSize;
-        
-        // Check if buffer is now full
-        if (writeIndex == readIndex) {
-            full = true;
-        }
-        
+        notifyAfterWrite(before);
         return 1;
     }
 
@@ -103,17 +124,11 @@ public:
      * @param size Number of bytes to write
      * @return Number of bytes written
      */
-    size_t write(const uint8_t *data, size_t size) {
-        size_t bytesWritten = 0;
-        
-        for (size_t i = 0; i < size; i++) {
-            if (write(data[i])) {
-                bytesWritten++;
-            } else {
-                break;
-            }
-        }
-        
+    size_t write(const uint8_t *data, size_t size) override {
+        size_t before = usedBytes();
+        size_t bytesWritten = std::min(size, maxSize - before);
+        copyIn(data, bytesWritten);
+        notifyAfterWrite(before);
         return bytesWritten;
     }
 
@@ -121,9 +136,11 @@ public:
      * @brief Clear the buffer, removing all content
      */
     void flush() override {
+        size_t before = usedBytes();
         readIndex = 0;
         writeIndex = 0;
         full = false;
+        notifyAfterRead(before);
     }
 
     /**
@@ -170,7 +187,7 @@ public:
      * @return Number of bytes in the buffer
      */
     size_t used() const {
-        return available();
+        return usedBytes();
     }
 
     /**
@@ -178,7 +195,50 @@ public:
      * @return Number of free bytes in the buffer
      */
     size_t free() const {
-        return maxSize - available();
+        return maxSize - usedBytes();
+    }
+
+    /**
+     * @brief Register a callback for the high watermark
+     *
+     * The callback is called once each time the fill level rises from below
+     * the level to the level or above, e.g. to wake up a consumer when a full
+     * chunk is ready or to pause a producer before the buffer overflows.
+     * @param level Fill level in bytes (e.g. size() * 3 / 4)
+     * @param callback Function to call; nullptr removes the callback
+     */
+    void setHighWatermark(size_t level, WatermarkCallback callback) {
+        highWatermark = level;
+        highWatermarkCallback = callback;
+    }
+
+    /**
+     * @brief Register a callback for the low watermark
+     *
+     * The callback is called once each time the fill level drops from above
+     * the level to the level or below, e.g. to resume a paused producer.
+     * @param level Fill level in bytes (e.g. size() / 4)
+     * @param callback Function to call; nullptr removes the callback
+     */
+    void setLowWatermark(size_t level, WatermarkCallback callback) {
+        lowWatermark = level;
+        lowWatermarkCallback = callback;
+    }
+
+    /**
+     * @brief Check if the fill level is at or above the high watermark
+     * @return true if a high watermark is defined and has been reached
+     */
+    bool isAboveHighWatermark() const {
+        return highWatermarkCallback && usedBytes() >= highWatermark;
+    }
+
+    /**
+     * @brief Check if the fill level is at or below the low watermark
+     * @return true if a low watermark is defined and has been reached
+     */
+    bool isBelowLowWatermark() const {
+        return lowWatermarkCallback && usedBytes() <= lowWatermark;
     }
 
     /**
@@ -188,18 +248,11 @@ public:
      * @return Number of bytes actually read
      */
     size_t readBytes(char* buffer, size_t size) override {
-        size_t bytesRead = 0;
-        
-        for (size_t i = 0; i < size; i++) {
-            int value = read();
-            if (value >= 0) {
-                buffer[i] = (char)value;
-                bytesRead++;
-            } else {
-                break;
-            }
-        }
-        
+        size_t before = usedBytes();
+        size_t bytesRead = std::min(size, before);
+        copyOut(0, reinterpret_cast<uint8_t*>(buffer), bytesRead);
+        advanceRead(bytesRead);
+        notifyAfterRead(before);
         return bytesRead;
     }
 
@@ -213,6 +266,209 @@ public:
         return readBytes(reinterpret_cast<char*>(buffer), size);
     }
 
+    /**
+     * @brief Get zero-copy access to the buffered data
+     *
+     * Only available for contiguous storage (RAM and PSRAM). The spans are
+     * invalidated by any read from or write to the buffer.
+     * @return The (up to) two contiguous parts of the data, oldest first
+     */
+    RingSegments<const uint8_t> segments() const {
+        size_t count = usedBytes();
+        size_t first = std::min(count, maxSize - readIndex);
+        const uint8_t* data = buffer.data();
+        return RingSegments<const uint8_t>(
+            Span<const uint8_t>(data + readIndex, first),
+            Span<const uint8_t>(data, count - first));
+    }
+
+    /**
+     * @brief Get an iterator to the oldest buffered byte
+     * @return Iterator to the first byte
+     */
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    /**
+     * @brief Get an iterator past the newest buffered byte
+     * @return Iterator to one past the last byte
+     */
+    const_iterator end() const {
+        return const_iterator(this, usedBytes());
+    }
+
+    /**
+     * @brief Write the buffered data directly to another stream
+     *
+     * The data is passed to the output from the contiguous segments of the
+     * buffer, so no intermediate copy is needed.
+     * @param out Destination
+     * @param max Maximum number of bytes to transfer
+     * @return Number of bytes transferred
+     */
+    size_t writeTo(Print& out, size_t max = SIZE_MAX) {
+        size_t before = usedBytes();
+        size_t total = 0;
+        while (total < max && !isEmpty()) {
+            size_t end = (full || writeIndex <= readIndex) ? maxSize : writeIndex;
+            size_t count = std::min(max - total, end - readIndex);
+            const uint8_t* ptr = bulkPointer(buffer, readIndex, count);
+            if (ptr == nullptr) break;
+            size_t written = out.write(ptr, count);
+            advanceRead(written);
+            total += written;
+            if (written < count) break;
+        }
+        notifyAfterRead(before);
+        return total;
+    }
+
+    /**
+     * @brief Read the available data of another stream directly into the buffer
+     *
+     * The data is read into the contiguous free segments of the buffer, so no
+     * intermediate copy is needed. Only the bytes reported by in.available()
+     * are requested, so the call does not block.
+     * @param in Source
+     * @param max Maximum number of bytes to transfer
+     * @return Number of bytes transferred
+     */
+    size_t readFrom(Stream& in, size_t max = SIZE_MAX) {
+        size_t before = usedBytes();
+        size_t total = 0;
+        while (total < max && !full) {
+            int available = in.available();
+            if (available <= 0) break;
+            size_t end = readIndex > writeIndex ? readIndex : maxSize;
+            size_t count = std::min(std::min(max - total, (size_t)available),
+                                    end - writeIndex);
+            uint8_t* ptr = bulkPointer(buffer, writeIndex, count);
+            if (ptr == nullptr) break;
+            size_t read = in.readBytes(ptr, count);
+            advanceWrite(read);
+            total += read;
+            if (read < count) break;
+        }
+        notifyAfterWrite(before);
+        return total;
+    }
+
+    /**
+     * @brief Write a complete message
+     *
+     * The message is stored with a length prefix and is committed atomically:
+     * either the whole message is written or nothing. If the message does not
+     * fit contiguously before the end of the buffer, the rest of the buffer is
+     * skipped (padding) and the message is written at the start, so that a
+     * message is never split.
+     * @param data Pointer to the message data
+     * @param len Length of the message in bytes
+     * @return true if the message was written, false if there is not enough space
+     */
+    bool writeMessage(const uint8_t* data, size_t len) {
+        size_t total = sizeof(MessageHeader) + len;
+        if (len >= kPaddingMarker || total > maxSize) {
+            return false;
+        }
+        size_t before = usedBytes();
+        if (before == 0) {
+            // empty: start at the beginning to avoid padding
+            readIndex = writeIndex = 0;
+        }
+        size_t tail = maxSize - writeIndex;
+        size_t padding = tail < total ? tail : 0;
+        if (full || padding + total > maxSize - before) {
+            return false;
+        }
+        if (padding >= sizeof(MessageHeader)) {
+            MessageHeader marker = kPaddingMarker;
+            copyIn(reinterpret_cast<const uint8_t*>(&marker), sizeof(marker));
+            advanceWrite(padding - sizeof(marker));
+        } else {
+            advanceWrite(padding);
+        }
+        MessageHeader header = len;
+        copyIn(reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+        copyIn(data, len);
+        notifyAfterWrite(before);
+        return true;
+    }
+
+    /**
+     * @brief Check if a complete message is available
+     * @return true if readMessage() or peekMessage() will return a message
+     */
+    bool hasMessage() {
+        return nextMessageSize() != kPaddingMarker;
+    }
+
+    /**
+     * @brief Get the length of the next message
+     * @return Length of the next message in bytes, or 0 if there is none
+     */
+    size_t messageSize() {
+        MessageHeader len = nextMessageSize();
+        return len == kPaddingMarker ? 0 : len;
+    }
+
+    /**
+     * @brief Copy the next message out of the buffer and remove it
+     * @param dest Destination buffer
+     * @param maxLen Size of the destination buffer
+     * @return Length of the message, or 0 if there is no message or it does not
+     * fit into the destination buffer (in which case it stays in the buffer)
+     */
+    size_t readMessage(uint8_t* dest, size_t maxLen) {
+        MessageHeader len = nextMessageSize();
+        if (len == kPaddingMarker || len > maxLen) {
+            return 0;
+        }
+        size_t before = usedBytes();
+        copyOut(sizeof(MessageHeader), dest, len);
+        advanceRead(sizeof(MessageHeader) + len);
+        notifyAfterRead(before);
+        return len;
+    }
+
+    /**
+     * @brief Get zero-copy access to the next message without removing it
+     *
+     * Call consumeMessage() when the data is no longer needed. The span is
+     * invalidated by any write to the buffer. For HIMEM the message must be
+     * within a single 32K window, otherwise an empty span is returned and
+     * readMessage() must be used instead.
+     * @return Span of the message data or an empty span if there is none
+     */
+    Span<const uint8_t> peekMessage() {
+        MessageHeader len = nextMessageSize();
+        if (len == kPaddingMarker) {
+            return Span<const uint8_t>();
+        }
+        size_t count = len;
+        const uint8_t* ptr =
+            bulkPointer(buffer, readIndex + sizeof(MessageHeader), count);
+        if (count < len) {
+            return Span<const uint8_t>();
+        }
+        return Span<const uint8_t>(ptr, len);
+    }
+
+    /**
+     * @brief Remove the next message without copying it
+     * @return true if a message was removed, false if there is none
+     */
+    bool consumeMessage() {
+        MessageHeader len = nextMessageSize();
+        if (len == kPaddingMarker) {
+            return false;
+        }
+        size_t before = usedBytes();
+        advanceRead(sizeof(MessageHeader) + len);
+        notifyAfterRead(before);
+        return true;
+    }
+
     /**
      * @brief Get direct access to the underlying vector
      * @return Reference to the underlying vector
@@ -228,6 +484,161 @@ public:
     const VectorType& getVector() const {
         return buffer;
     }
+
+private:
+    /// Length prefix of a framed message
+    using MessageHeader = uint32_t;
+    /// Header value which marks the rest of the buffer as padding
+    static constexpr MessageHeader kPaddingMarker = 0xFFFFFFFF;
+
+    friend const_iterator;
+
+    /**
+     * @brief Access a buffered byte by its index relative to the read position
+     * @param index The relative index
+     * @return The byte
+     */
+    uint8_t elementAt(size_t index) const {
+        size_t actualIndex = readIndex + index;
+        if (actualIndex >= maxSize) actualIndex -= maxSize;
+        uint8_t value = 0;
+        bulkRead(buffer, actualIndex, &value, 1);
+        return value;
+    }
+
+    /**
+     * @brief Skip padding and determine the length of the next message
+     * @return Length of the next message or kPaddingMarker if there is none
+     */
+    MessageHeader nextMessageSize() {
+        while (!isEmpty()) {
+            size_t tail = maxSize - readIndex;
+            MessageHeader header = kPaddingMarker;
+            if (tail >= sizeof(MessageHeader)) {
+                copyOut(0, reinterpret_cast<uint8_t*>(&header), sizeof(header));
+            }
+            if (header != kPaddingMarker) {
+                return header;
+            }
+            // skip the padding at the end of the buffer
+            advanceRead(std::min(tail, usedBytes()));
+        }
+        return kPaddingMarker;
+    }
+
+    /**
+     * @brief Copy data to the write position (at most two segment copies)
+     * @param data Data to copy
+     * @param len Number of bytes, which must not exceed the free space
+     */
+    void copyIn(const uint8_t* data, size_t len) {
+        size_t first = std::min(len, maxSize - writeIndex);
+        bulkWrite(buffer, writeIndex, data, first);
+        bulkWrite(buffer, 0, data + first, len - first);
+        advanceWrite(len);
+    }
+
+    /**
+     * @brief Copy data from the read position (at most two segment copies)
+     * @param offset Offset relative to the read position
+     * @param dest Destination buffer
+     * @param len Number of bytes, which must be available
+     */
+    void copyOut(size_t offset, uint8_t* dest, size_t len) const {
+        size_t start = (readIndex + offset) % maxSize;
+        size_t first = std::min(len, maxSize - start);
+        bulkRead(buffer, start, dest, first);
+        bulkRead(buffer, 0, dest + first, len - first);
+    }
+
+    /**
+     * @brief Advance the write position
+     * @param len Number of bytes
+     */
+    void advanceWrite(size_t len) {
+        if (len == 0) return;
+        writeIndex = (writeIndex + len) % maxSize;
+        if (writeIndex == readIndex) {
+            full = true;
+        }
+    }
+
+    /**
+     * @brief Advance the read position
+     * @param len Number of bytes
+     */
+    void advanceRead(size_t len) {
+        if (len == 0) return;
+        readIndex = (readIndex + len) % maxSize;
+        full = false;
+    }
+
+    /**
+     * @brief Determine the number of bytes currently in the buffer
+     * @return Number of bytes in the buffer
+     */
+    size_t usedBytes() const {
+        if (full) {
+            return maxSize;
+        }
+        if (writeIndex >= readIndex) {
+            return writeIndex - readIndex;
+        } else {
+            return maxSize - (readIndex - writeIndex);
+        }
+    }
+
+    /**
+     * @brief Read a byte without watermark notification
+     * @return The byte read, or -1 if the buffer is empty
+     */
+    int readByte() {
+        if (isEmpty()) {
+            return -1;
+        }
+
+        uint8_t value = 0;
+        bulkRead(buffer, readIndex, &value, 1);
+        advanceRead(1);
+        return value;
+    }
+
+    /**
+     * @brief Write a byte without watermark notification
+     * @param value The byte to write
+     * @return true if the byte was written, false if the buffer is full
+     */
+    bool writeByte(uint8_t value) {
+        if (full) {
+            return false;
+        }
+
+        bulkWrite(buffer, writeIndex, &value, 1);
+        advanceWrite(1);
+        return true;
+    }
+
+    /**
+     * @brief Call the high watermark callback if the level has been crossed
+     * @param before Fill level before the write operation
+     */
+    void notifyAfterWrite(size_t before) {
+        if (highWatermarkCallback && before < highWatermark &&
+            usedBytes() >= highWatermark) {
+            highWatermarkCallback(*this);
+        }
+    }
+
+    /**
+     * @brief Call the low watermark callback if the level has been crossed
+     * @param before Fill level before the read operation
+     */
+    void notifyAfterRead(size_t before) {
+        if (lowWatermarkCallback && before > lowWatermark &&
+            usedBytes() <= lowWatermark) {
+            lowWatermarkCallback(*this);
+        }
+    }
 };
 
 /**
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <iterator>
+
+namespace esp32_psram {
+
+/**
+ * @class RingIterator
+ * @brief Random access iterator over the content of a ring buffer
+ * @tparam Container The ring buffer class, which must provide
+ * elementAt(size_t) for relative indexes (oldest element = 0)
+ * @tparam Value The element type
+ * @tparam Reference The result type of elementAt(): a const reference for
+ * contiguous storage or a value for HIMEM
+ *
+ * The iterator stores the relative index from the read position, so it is
+ * invalidated when elements are removed from the ring buffer.
+ */
+template <typename Container, typename Value, typename Reference>
+class RingIterator {
+ public:
+  using iterator_category = std::random_access_iterator_tag;
+  using value_type = Value;
+  using difference_type = std::ptrdiff_t;
+  using reference = Reference;
+  using pointer = const Value*;
+
+  RingIterator() = default;
+  RingIterator(const Container* ring, size_t index)
+      : ring(ring), index(index) {}
+
+  reference operator*() const { return ring->elementAt(index); }
+  reference operator[](difference_type n) const {
+    return ring->elementAt(index + n);
+  }
+  RingIterator& operator++() {
+    ++index;
+    return *this;
+  }
+  RingIterator operator++(int) {
+    RingIterator tmp = *this;
+    ++index;
+    return tmp;
+  }
+  RingIterator& operator--() {
+    --index;
+    return *this;
+  }
+  RingIterator operator--(int) {
+    RingIterator tmp = *this;
+    --index;
+    return tmp;
+  }
+  RingIterator& operator+=(difference_type n) {
+    index += n;
+    return *this;
+  }
+  RingIterator& operator-=(difference_type n) {
+    index -= n;
+    return *this;
+  }
+  RingIterator operator+(difference_type n) const {
+    return RingIterator(ring, index + n);
+  }
+  RingIterator operator-(difference_type n) const {
+    return RingIterator(ring, index - n);
+  }
+  friend RingIterator operator+(difference_type n, const RingIterator& it) {
+    return it + n;
+  }
+  difference_type operator-(const RingIterator& other) const {
+    return (difference_type)index - (difference_type)other.index;
+  }
+  bool operator==(const RingIterator& other) const {
+    return index == other.index;
+  }
+  bool operator!=(const RingIterator& other) const {
+    return index != other.index;
+  }
+  bool operator<(const RingIterator& other) const {
+    return index < other.index;
+  }
+  bool operator>(const RingIterator& other) const {
+    return index > other.index;
+  }
+  bool operator<=(const RingIterator& other) const {
+    return index <= other.index;
+  }
+  bool operator>=(const RingIterator& other) const {
+    return index >= other.index;
+  }
+
+ private:
+  const Container* ring = nullptr;
+  size_t index = 0;
+};
+
+}  // namespace esp32_psram
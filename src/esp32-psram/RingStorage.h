@@ -0,0 +1,208 @@
+#pragma once
+
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "VectorAccess.h"
+
+namespace esp32_psram {
+
+/**
+ * @class RingStorage
+ * @brief Uninitialized element storage used by TypedRingBuffer
+ * @tparam T The data type to store
+ * @tparam VectorType The vector type which defines where the memory comes from
+ *
+ * The general version is used for vectors without an allocator (VectorHIMEM):
+ * they only hold plain data which is copied in and out of the HIMEM windows,
+ * so resizing the vector does not construct any elements.
+ *
+ * The slots are addressed by index. Elements are created with the construct
+ * and copyIn/moveIn methods and must be removed with moveOut or destroy.
+ */
+template <typename T, typename VectorType, typename = void>
+class RingStorage {
+ public:
+  /**
+   * @brief Allocate storage for the indicated number of elements
+   * @param capacity Number of slots
+   */
+  explicit RingStorage(size_t capacity) { buffer.resize(capacity); }
+
+  /**
+   * @brief Construct an element in a slot
+   * @param pos Slot index
+   * @param args Arguments to forward to the constructor of T
+   */
+  template <typename... Args>
+  void construct(size_t pos, Args&&... args) {
+    T value(std::forward<Args>(args)...);
+    bulkWrite(buffer, pos, &value, 1);
+  }
+
+  /**
+   * @brief Copy elements into empty slots
+   * @param pos Index of the first slot
+   * @param src Source elements
+   * @param count Number of elements
+   */
+  void copyIn(size_t pos, const T* src, size_t count) {
+    bulkWrite(buffer, pos, src, count);
+  }
+
+  /**
+   * @brief Copy elements from the occupied slots of another storage
+   * @param pos Index of the first empty slot
+   * @param other Source storage
+   * @param otherPos Index of the first slot in the source storage
+   * @param count Number of elements
+   */
+  void copyFrom(size_t pos, const RingStorage& other, size_t otherPos,
+                size_t count) {
+    T value;
+    for (size_t i = 0; i < count; i++) {
+      other.copyOut(otherPos + i, &value, 1);
+      copyIn(pos + i, &value, 1);
+    }
+  }
+
+  /**
+   * @brief Copy elements out of occupied slots
+   * @param pos Index of the first slot
+   * @param dest Destination
+   * @param count Number of elements
+   */
+  void copyOut(size_t pos, T* dest, size_t count) const {
+    bulkRead(buffer, pos, dest, count);
+  }
+
+  /**
+   * @brief Move elements out of occupied slots, leaving them empty
+   * @param pos Index of the first slot
+   * @param dest Destination
+   * @param count Number of elements
+   */
+  void moveOut(size_t pos, T* dest, size_t count) {
+    bulkMoveOut(buffer, pos, dest, count);
+  }
+
+  /**
+   * @brief Destroy the elements in occupied slots
+   * @param pos Index of the first slot
+   * @param count Number of elements
+   */
+  void destroy(size_t, size_t) {}
+
+  /**
+   * @brief Get a copy of the element in an occupied slot
+   * @param pos Slot index
+   * @return The element
+   */
+  T get(size_t pos) const {
+    T result;
+    bulkRead(buffer, pos, &result, 1);
+    return result;
+  }
+
+  /**
+   * @brief Get the underlying vector
+   * @return Reference to the vector
+   */
+  VectorType& vector() { return buffer; }
+
+ protected:
+  VectorType buffer;
+};
+
+/**
+ * @class RingStorage
+ * @brief Uninitialized element storage for vectors with an allocator
+ *
+ * The memory is requested from the allocator of the vector type (e.g.
+ * AllocatorPSRAM) without constructing any elements, so the setup is O(1) and
+ * T does not need to be default-constructible. Elements are created with
+ * placement new and destroyed explicitly.
+ */
+template <typename T, typename VectorType>
+class RingStorage<T, VectorType,
+                  decltype(void(sizeof(typename VectorType::allocator_type)))> {
+  using Allocator = typename std::allocator_traits<
+      typename VectorType::allocator_type>::template rebind_alloc<T>;
+
+ public:
+  explicit RingStorage(size_t capacity) : slot_count(capacity) {
+    // the allocators of this library don't support empty allocations
+    if (capacity > 0) slots = allocator.allocate(capacity);
+  }
+
+  ~RingStorage() {
+    if (slots) allocator.deallocate(slots, slot_count);
+  }
+
+  RingStorage(const RingStorage&) = delete;
+  RingStorage& operator=(const RingStorage&) = delete;
+
+  RingStorage(RingStorage&& other) noexcept
+      : slots(other.slots), slot_count(other.slot_count) {
+    other.slots = nullptr;
+    other.slot_count = 0;
+  }
+
+  RingStorage& operator=(RingStorage&& other) noexcept {
+    std::swap(slots, other.slots);
+    std::swap(slot_count, other.slot_count);
+    return *this;
+  }
+
+  template <typename... Args>
+  void construct(size_t pos, Args&&... args) {
+    new (slots + pos) T(std::forward<Args>(args)...);
+  }
+
+  void copyIn(size_t pos, const T* src, size_t count) {
+    std::uninitialized_copy_n(src, count, slots + pos);
+  }
+
+  void copyFrom(size_t pos, const RingStorage& other, size_t otherPos,
+                size_t count) {
+    std::uninitialized_copy_n(other.slots + otherPos, count, slots + pos);
+  }
+
+  void copyOut(size_t pos, T* dest, size_t count) const {
+    std::copy_n(slots + pos, count, dest);
+  }
+
+  void moveOut(size_t pos, T* dest, size_t count) {
+    std::move(slots + pos, slots + pos + count, dest);
+    destroy(pos, count);
+  }
+
+  void destroy(size_t pos, size_t count) {
+    if (!std::is_trivially_destructible<T>::value) {
+      for (size_t i = 0; i < count; i++) slots[pos + i].~T();
+    }
+  }
+
+  const T& get(size_t pos) const { return slots[pos]; }
+
+  /**
+   * @brief Get direct access to the slots
+   * @return Pointer to the first slot
+   */
+  T* data() { return slots; }
+
+  /**
+   * @brief Get direct access to the slots (const version)
+   * @return Pointer to the first slot
+   */
+  const T* data() const { return slots; }
+
+ protected:
+  Allocator allocator;
+  T* slots = nullptr;
+  size_t slot_count = 0;
+};
+
+}  // namespace esp32_psram
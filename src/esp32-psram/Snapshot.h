@@ -0,0 +1,127 @@
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+#include "BinaryFormat.h"
+#include "RWLock.h"
+#include "VectorAccess.h"
+
+namespace esp32_psram {
+
+/**
+ * @brief Layout of a file system image as written by InMemoryFS::snapshot()
+ *
+ * All numbers are little endian:
+ * - header (16 bytes): magic "IMFS", version (1 byte), flags (1 byte),
+ *   reserved (2 bytes), number of entries (4 bytes), size of the index in
+ *   bytes (4 bytes)
+ * - index, one record per entry in the order of the data: type (1 byte,
+ *   0 = file, 1 = directory), path length (2 bytes), path; files continue
+ *   with the size (4 bytes) and the CRC-32 of the content (4 bytes, 0 if
+ *   the image has no checksums)
+ * - data: the file contents without any separator
+ */
+namespace snapshot {
+constexpr uint8_t kMagic[4] = {'I', 'M', 'F', 'S'};
+constexpr uint8_t kVersion = 1;
+constexpr uint8_t kFlagChecksums = 1;
+constexpr size_t kHeaderSize = 16;
+constexpr uint8_t kTypeFile = 0;
+constexpr uint8_t kTypeDirectory = 1;
+/// Size of the buffer which is used to copy from a stream
+constexpr size_t kCopyBufferSize = 512;
+}  // namespace snapshot
+
+/**
+ * @class SnapshotSource
+ * @brief Random access to a file system image for a lazy restore
+ */
+class SnapshotSource {
+ public:
+  virtual ~SnapshotSource() = default;
+
+  /**
+   * @brief Read a range of the image
+   * @param offset Position in the image
+   * @param data Destination buffer
+   * @param len Number of bytes
+   * @return Number of bytes read
+   */
+  virtual size_t readAt(size_t offset, uint8_t* data, size_t len) = 0;
+};
+
+/**
+ * @class FileSnapshotSource
+ * @brief SnapshotSource for a seekable file, e.g. fs::File of SD or LittleFS
+ * @tparam File Stream based file type with seek(pos), like fs::File
+ *
+ * The file is accessed by one task at a time.
+ */
+template <typename File>
+class FileSnapshotSource : public SnapshotSource {
+ public:
+  explicit FileSnapshotSource(File file) : file(file) {}
+
+  size_t readAt(size_t offset, uint8_t* data, size_t len) override {
+    RWLock::WriteGuard guard(lock);
+    if (!file.seek(offset)) return 0;
+    return file.readBytes(reinterpret_cast<char*>(data), len);
+  }
+
+ protected:
+  File file;
+  RWLock lock;
+};
+
+/**
+ * @struct PendingContent
+ * @brief File content which is still in the image of a lazy restore
+ */
+struct PendingContent {
+  std::shared_ptr<SnapshotSource> source;
+  size_t offset = 0;
+  size_t size = 0;
+  uint32_t crc = 0;
+  bool verify = false;
+  /// true until the content was loaded (checked without lock)
+  std::atomic<bool> active{false};
+
+  /**
+   * @brief Copy the content into the file storage; the caller holds the
+   * write lock of the file
+   * @param data The storage, which is expected to be empty
+   * @return false if the content could not be read or the checksum does not
+   * match: the storage is cleared in this case
+   */
+  template <typename VectorType>
+  bool load(VectorType& data) {
+    if (!active.load(std::memory_order_acquire)) return true;
+    uint8_t buffer[snapshot::kCopyBufferSize];
+    uint32_t actual = 0;
+    size_t done = 0;
+    while (done < size) {
+      size_t n = std::min(size - done, sizeof(buffer));
+      if (source->readAt(offset + done, buffer, n) != n) break;
+      if (verify) actual = binary::crc32(actual, buffer, n);
+      if (bulkAppend(data, buffer, n) != n) break;
+      done += n;
+    }
+    bool ok = done == size && (!verify || actual == crc);
+    if (!ok) {
+      ESP_LOGE("Snapshot", "Restoring file content failed at offset %u",
+               (unsigned)offset);
+      data.clear();
+    }
+    releaseWindow(data);
+    source.reset();
+    active.store(false, std::memory_order_release);
+    return ok;
+  }
+};
+
+}  // namespace esp32_psram
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+
+namespace esp32_psram {
+
+/**
+ * @class SpaceAccount
+ * @brief Thread-safe counter of the memory which is used by a file system,
+ * with an optional quota
+ *
+ * The storage of the files charges the memory it actually allocates (whole
+ * pages and page tables), so the counter includes the slack of partially
+ * filled pages and of the HIMEM block rounding.
+ */
+class SpaceAccount {
+ public:
+  SpaceAccount() = default;
+  SpaceAccount(const SpaceAccount&) = delete;
+  SpaceAccount& operator=(const SpaceAccount&) = delete;
+
+  /**
+   * @brief Charge memory which is about to be allocated, if it fits into the
+   * quota
+   * @param bytes The size of the allocation
+   * @return true if charged, false if the quota would be exceeded
+   */
+  bool allocate(size_t bytes) {
+    size_t current = used_.load(std::memory_order_relaxed);
+    do {
+      size_t limit = quota_.load(std::memory_order_relaxed);
+      if (limit != 0 && (current > limit || bytes > limit - current)) {
+        return false;
+      }
+    } while (!used_.compare_exchange_weak(current, current + bytes,
+                                          std::memory_order_relaxed));
+    return true;
+  }
+
+  /**
+   * @brief Charge memory which was allocated, independent of the quota
+   * @param bytes The size of the allocation
+   */
+  void charge(size_t bytes) {
+    used_.fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Give back memory which was freed
+   * @param bytes The size of the allocation
+   */
+  void release(size_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the charged memory
+   * @return Used bytes
+   */
+  size_t used() const { return used_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Limit the memory which can be allocated; memory which is already
+   * used is not affected
+   * @param bytes The quota in bytes, 0 for no limit
+   */
+  void setQuota(size_t bytes) {
+    quota_.store(bytes, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Get the quota
+   * @return The quota in bytes, 0 if there is no limit
+   */
+  size_t quota() const { return quota_.load(std::memory_order_relaxed); }
+
+  /**
+   * @brief Get the memory which can still be allocated within the quota
+   * @return Bytes, SIZE_MAX if there is no quota
+   */
+  size_t available() const {
+    size_t limit = quota();
+    if (limit == 0) return SIZE_MAX;
+    size_t current = used();
+    return current < limit ? limit - current : 0;
+  }
+
+ protected:
+  std::atomic<size_t> used_{0};
+  std::atomic<size_t> quota_{0};
+};
+
+/**
+ * @brief Shared ownership of an account: storage which outlives its file
+ * system (e.g. a handle of a removed file) can still release its memory
+ */
+using SpaceAccountPtr = std::shared_ptr<SpaceAccount>;
+
+}  // namespace esp32_psram
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <stddef.h>
+
+namespace esp32_psram {
+
+/**
+ * @class Span
+ * @brief Non-owning view of a contiguous sequence of elements
+ * @tparam T Type of the elements (use const T for read-only views)
+ *
+ * A minimal replacement for std::span (which requires C++20) that is used
+ * to give zero-copy access to data held in PSRAM or in a mapped HIMEM window.
+ * A span does not own the data: it is only valid as long as the underlying
+ * storage is not modified, reallocated or (for HIMEM) remapped.
+ */
+template <typename T>
+class Span {
+ public:
+  using element_type = T;
+  using size_type = size_t;
+  using pointer = T*;
+  using reference = T&;
+  using iterator = T*;
+
+  /**
+   * @brief Default constructor - creates an empty span
+   */
+  Span() = default;
+
+  /**
+   * @brief Constructs a span over count elements starting at ptr
+   * @param ptr Pointer to the first element
+   * @param count Number of elements
+   */
+  Span(T* ptr, size_t count) : ptr_(ptr), size_(ptr ? count : 0) {}
+
+  /**
+   * @brief Conversion from a compatible span (e.g. Span<T> to Span<const T>)
+   * @param other The span to convert
+   */
+  template <typename U>
+  Span(const Span<U>& other) : ptr_(other.data()), size_(other.size()) {}
+
+  /**
+   * @brief Get pointer to the first element
+   * @return Pointer to the first element
+   */
+  T* data() const { return ptr_; }
+
+  /**
+   * @brief Get the number of elements
+   * @return Number of elements in the span
+   */
+  size_t size() const { return size_; }
+
+  /**
+   * @brief Get the size in bytes
+   * @return Number of bytes covered by the span
+   */
+  size_t size_bytes() const { return size_ * sizeof(T); }
+
+  /**
+   * @brief Check if the span is empty
+   * @return true if the span does not contain any elements
+   */
+  bool empty() const { return size_ == 0; }
+
+  /**
+   * @brief Access an element without bounds checking
+   * @param pos The position of the element
+   * @return Reference to the element
+   */
+  T& operator[](size_t pos) const { return ptr_[pos]; }
+
+  /**
+   * @brief Get iterator to the beginning
+   * @return Pointer to the first element
+   */
+  T* begin() const { return ptr_; }
+
+  /**
+   * @brief Get iterator to the end
+   * @return Pointer to one past the last element
+   */
+  T* end() const { return ptr_ + size_; }
+
+  /**
+   * @brief Get a sub span
+   * @param offset Index of the first element
+   * @param count Number of elements (limited to the available elements)
+   * @return The sub span
+   */
+  Span<T> subspan(size_t offset, size_t count = (size_t)-1) const {
+    if (offset >= size_) return Span<T>();
+    size_t rest = size_ - offset;
+    return Span<T>(ptr_ + offset, count < rest ? count : rest);
+  }
+
+ protected:
+  T* ptr_ = nullptr;
+  size_t size_ = 0;
+};
+
+/**
+ * @class RingSegments
+ * @brief The (up to) two contiguous parts of a range in a ring buffer
+ * @tparam T Type of the elements
+ *
+ * A range in a ring buffer which wraps around the end of the storage is
+ * split into two spans: the first one up to the end of the storage and the
+ * second one from the start of the storage.
+ */
+template <typename T>
+class RingSegments {
+ public:
+  RingSegments() = default;
+
+  /**
+   * @brief Constructor
+   * @param first The first part of the range
+   * @param second The second part of the range (may be empty)
+   */
+  RingSegments(Span<T> first, Span<T> second)
+      : first_(first), second_(second) {}
+
+  /**
+   * @brief Get the first part
+   * @return Span which starts at the beginning of the range
+   */
+  Span<T> first() const { return first_; }
+
+  /**
+   * @brief Get the second part
+   * @return Span with the wrapped part of the range (may be empty)
+   */
+  Span<T> second() const { return second_; }
+
+  /**
+   * @brief Get the total number of elements
+   * @return Number of elements in both parts
+   */
+  size_t size() const { return first_.size() + second_.size(); }
+
+  /**
+   * @brief Check if the range is empty
+   * @return true if both parts are empty
+   */
+  bool empty() const { return size() == 0; }
+
+ protected:
+  Span<T> first_;
+  Span<T> second_;
+};
+
+}  // namespace esp32_psram
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "RingIterator.h"
+#include "Span.h"
+
+#if __has_include(<esp_attr.h>)
+#include <esp_attr.h>
+#endif
+
+/// Places a static object into the PSRAM .bss segment (needs
+/// CONFIG_SPIRAM_ALLOW_BSS_SEG_EXTERNAL_MEMORY, otherwise it stays in DRAM)
+#ifndef EXT_RAM_BSS_ATTR
+#ifdef EXT_RAM_ATTR
+#define EXT_RAM_BSS_ATTR EXT_RAM_ATTR
+#else
+#define EXT_RAM_BSS_ATTR
+#endif
+#endif
+
+namespace esp32_psram {
+
+/**
+ * @class StaticRingBuffer
+ * @brief Ring buffer with a capacity which is fixed at compile time
+ * @tparam T The data type to store in the buffer
+ * @tparam N The capacity in number of elements
+ *
+ * The elements are stored in an array inside of the object, so nothing is
+ * allocated at runtime and the object can be constant-initialized. Where the
+ * memory comes from is decided by where the object is defined: a global or
+ * static object lives in DRAM by default and in PSRAM if it is marked with
+ * EXT_RAM_BSS_ATTR:
+ * @code
+ * EXT_RAM_BSS_ATTR static StaticRingBuffer<Sample, 4096> samples;  // PSRAM
+ * static StaticRingBuffer<Sample, 256> recent;                     // DRAM
+ * @endcode
+ *
+ * Since the capacity is a constant, the index calculations are folded by the
+ * compiler: for a power of two capacity the read and write positions are
+ * free-running counters which are masked, otherwise they wrap at 2 * N so
+ * that a full and an empty buffer can be told apart without a flag.
+ *
+ * Elements are constructed when they are pushed and destroyed when they are
+ * popped or cleared, like in TypedRingBuffer.
+ */
+template <typename T, size_t N>
+class StaticRingBuffer {
+  static_assert(N > 0, "StaticRingBuffer needs a capacity of at least 1");
+  static_assert(N <= SIZE_MAX / 4, "StaticRingBuffer capacity is too big");
+
+ public:
+  /**
+   * @brief Random access iterator over the elements, oldest first
+   *
+   * The iterator is invalidated when elements are removed.
+   */
+  using const_iterator = RingIterator<StaticRingBuffer, T, const T&>;
+  using iterator = const_iterator;
+
+  /**
+   * @brief Constructor: the buffer is empty and no element is constructed
+   */
+  constexpr StaticRingBuffer() = default;
+
+  StaticRingBuffer(const StaticRingBuffer&) = delete;
+  StaticRingBuffer& operator=(const StaticRingBuffer&) = delete;
+
+  /**
+   * @brief Destructor: destroys the remaining elements
+   */
+  ~StaticRingBuffer() { clear(); }
+
+  /**
+   * @brief Push an element to the buffer
+   * @param value The value to add
+   * @return true if the element was added, false if the buffer is full
+   */
+  bool push(const T& value) { return emplace(value); }
+
+  /**
+   * @brief Push an element to the buffer by moving it
+   * @param value The value to add
+   * @return true if the element was added, false if the buffer is full
+   */
+  bool push(T&& value) { return emplace(std::move(value)); }
+
+  /**
+   * @brief Construct an element from the arguments and add it to the buffer
+   * @param args Arguments to forward to the constructor of T
+   * @return true if the element was added, false if the buffer is full
+   */
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    if (isFull()) {
+      return false;
+    }
+    new (slot(writePos)) T(std::forward<Args>(args)...);
+    writePos = advance(writePos, 1);
+    return true;
+  }
+
+  /**
+   * @brief Push an element to the buffer, overwriting oldest data if full
+   * @param value The value to add
+   * @return true if an old element was overwritten, false otherwise
+   */
+  bool pushOverwrite(const T& value) {
+    bool overwritten = isFull();
+    if (overwritten) {
+      slot(readPos)->~T();
+      readPos = advance(readPos, 1);
+    }
+    new (slot(writePos)) T(value);
+    writePos = advance(writePos, 1);
+    return overwritten;
+  }
+
+  /**
+   * @brief Push multiple elements to the buffer
+   * @param values Pointer to the elements to add
+   * @param count Number of elements to add
+   * @return Number of elements added (limited by the free space)
+   */
+  size_t pushN(const T* values, size_t count) {
+    count = std::min(count, availableForWrite());
+    size_t start = index(writePos);
+    size_t first = std::min(count, N - start);
+    std::uninitialized_copy_n(values, first, slot(writePos));
+    std::uninitialized_copy_n(values + first, count - first, data());
+    writePos = advance(writePos, count);
+    return count;
+  }
+
+  /**
+   * @brief Pop an element from the buffer
+   * @param value Reference to store the popped value
+   * @return true if an element was popped, false if the buffer is empty
+   */
+  bool pop(T& value) {
+    if (isEmpty()) {
+      return false;
+    }
+    T* element = slot(readPos);
+    value = std::move(*element);
+    element->~T();
+    readPos = advance(readPos, 1);
+    return true;
+  }
+
+  /**
+   * @brief Pop multiple elements from the buffer
+   * @param values Pointer to the destination for the popped elements
+   * @param count Maximum number of elements to pop
+   * @return Number of elements popped (limited by the available elements)
+   */
+  size_t popN(T* values, size_t count) {
+    count = std::min(count, available());
+    RingSegments<T> parts = range(0, count);
+    T* dest = std::move(parts.first().begin(), parts.first().end(), values);
+    std::move(parts.second().begin(), parts.second().end(), dest);
+    destroy(parts);
+    readPos = advance(readPos, count);
+    return count;
+  }
+
+  /**
+   * @brief Peek at the next element without removing it
+   * @param value Reference to store the peeked value
+   * @return true if an element was peeked, false if the buffer is empty
+   */
+  bool peek(T& value) const { return peekAt(0, value); }
+
+  /**
+   * @brief Get the element at a specific index relative to the read position
+   * @param index The relative index from current read position
+   * @param value Reference to store the value
+   * @return true if the element exists, false otherwise
+   */
+  bool peekAt(size_t index, T& value) const {
+    if (index >= available()) {
+      return false;
+    }
+    value = elementAt(index);
+    return true;
+  }
+
+  /**
+   * @brief Get the contiguous parts of a range of elements
+   * @param index Relative index of the first element (oldest = 0)
+   * @param count Number of elements (limited by the available elements)
+   * @return The (up to) two spans which contain the range
+   */
+  RingSegments<const T> segments(size_t index, size_t count) const {
+    if (index > available()) index = available();
+    count = std::min(count, available() - index);
+    RingSegments<T> parts =
+        const_cast<StaticRingBuffer*>(this)->range(index, count);
+    return RingSegments<const T>(parts.first(), parts.second());
+  }
+
+  /**
+   * @brief Get the contiguous parts of all elements
+   * @return The (up to) two spans which contain all elements, oldest first
+   */
+  RingSegments<const T> segments() const { return segments(0, available()); }
+
+  /**
+   * @brief Iterator to the oldest element
+   * @return const_iterator
+   */
+  const_iterator begin() const { return const_iterator(this, 0); }
+
+  /**
+   * @brief Iterator past the newest element
+   * @return const_iterator
+   */
+  const_iterator end() const { return const_iterator(this, available()); }
+
+  /**
+   * @brief Clear the buffer and destroy all elements
+   */
+  void clear() {
+    destroy(range(0, available()));
+    readPos = 0;
+    writePos = 0;
+  }
+
+  /**
+   * @brief Check if the buffer is empty
+   * @return true if the buffer is empty, false otherwise
+   */
+  bool isEmpty() const { return readPos == writePos; }
+
+  /**
+   * @brief Check if the buffer is full
+   * @return true if the buffer is full, false otherwise
+   */
+  bool isFull() const { return available() == N; }
+
+  /**
+   * @brief Get the number of elements in the buffer
+   * @return Number of elements
+   */
+  size_t available() const {
+    if (kPowerOfTwo) {
+      return writePos - readPos;
+    } else {
+      return writePos >= readPos ? writePos - readPos
+                                 : writePos + kWrap - readPos;
+    }
+  }
+
+  /**
+   * @brief Get the number of free slots in the buffer
+   * @return Number of free slots
+   */
+  size_t availableForWrite() const { return N - available(); }
+
+  /**
+   * @brief Get the capacity of the buffer
+   * @return Maximum number of elements
+   */
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  friend const_iterator;
+
+  /// Power of two capacities use free-running masked positions
+  static constexpr bool kPowerOfTwo = (N & (N - 1)) == 0;
+  /// Other capacities wrap the positions at twice the capacity
+  static constexpr size_t kWrap = 2 * N;
+
+  alignas(T) uint8_t storage[N * sizeof(T)] = {};
+  size_t readPos = 0;
+  size_t writePos = 0;
+
+  /**
+   * @brief Convert a read or write position to a slot index
+   * @param pos Position
+   * @return Index in [0, N)
+   */
+  static size_t index(size_t pos) {
+    if (kPowerOfTwo) {
+      return pos & (N - 1);
+    } else {
+      return pos < N ? pos : pos - N;
+    }
+  }
+
+  /**
+   * @brief Move a read or write position forward
+   * @param pos Position
+   * @param count Number of elements (at most N)
+   * @return The new position
+   */
+  static size_t advance(size_t pos, size_t count) {
+    if (kPowerOfTwo) {
+      return pos + count;
+    } else {
+      pos += count;
+      return pos >= kWrap ? pos - kWrap : pos;
+    }
+  }
+
+  T* data() { return reinterpret_cast<T*>(storage); }
+  const T* data() const { return reinterpret_cast<const T*>(storage); }
+  T* slot(size_t pos) { return data() + index(pos); }
+
+  /**
+   * @brief Access an element by its relative index without bounds checking
+   * @param index The relative index
+   * @return The element
+   */
+  const T& elementAt(size_t relative) const {
+    return data()[index(advance(readPos, relative))];
+  }
+
+  /**
+   * @brief Split a range of elements into contiguous parts
+   * @param relative Relative index of the first element
+   * @param count Number of elements
+   * @return The (up to) two spans
+   */
+  RingSegments<T> range(size_t relative, size_t count) {
+    size_t start = index(advance(readPos, relative));
+    size_t first = std::min(count, N - start);
+    return RingSegments<T>(Span<T>(data() + start, first),
+                           Span<T>(data(), count - first));
+  }
+
+  /**
+   * @brief Destroy the elements in a range
+   * @param parts The range
+   */
+  static void destroy(RingSegments<T> parts) {
+    for (T& element : parts.first()) element.~T();
+    for (T& element : parts.second()) element.~T();
+  }
+};
+
+}  // namespace esp32_psram
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <type_traits>
+#include <vector>
+
+namespace esp32_psram {
+
+/**
+ * @struct PumpResult
+ * @brief Statistics of a StreamPump transfer
+ */
+struct PumpResult {
+  /// Number of bytes transferred
+  size_t bytes = 0;
+  /// Duration of the transfer in microseconds
+  uint32_t durationUs = 0;
+
+  /**
+   * @brief Get the throughput of the transfer
+   * @return Bytes per second (0 if nothing was transferred)
+   */
+  float bytesPerSecond() const {
+    if (bytes == 0) return 0.0f;
+    if (durationUs == 0) return (float)bytes * 1000000.0f;
+    return (float)bytes * 1000000.0f / durationUs;
+  }
+};
+
+/**
+ * @class StreamPump
+ * @brief Copies data from a Stream to a Print (e.g. another Stream) in chunks
+ *
+ * Instead of per-byte read()/write() loops the pump uses the fastest path
+ * which is available for the involved types:
+ * - if the source provides writeTo(Print&, size_t) (RingBufferStream,
+ *   InMemoryFile) the data is written straight from its storage.
+ * - if the destination provides readFrom(Stream&, size_t) (RingBufferStream)
+ *   the data is read straight into its storage.
+ * - otherwise the data is copied with readBytes()/write() via an internal
+ *   buffer which is allocated once and reused by subsequent calls. If the
+ *   destination overrides availableForWrite(), no more than the reported
+ *   space is read from the source for each chunk.
+ *
+ * The type detection is done at compile time, so the library types must be
+ * passed with their real type and not as a Stream reference.
+ */
+class StreamPump {
+ public:
+  /**
+   * @brief Constructor
+   * @param bufferSize Size of the internal copy buffer in bytes
+   */
+  StreamPump(size_t bufferSize = 1024) : buffer_size(bufferSize) {}
+
+  /**
+   * @brief Copy data from src to dst
+   *
+   * The copying stops when max bytes have been transferred, when the
+   * source has no more data available or when the destination does not
+   * accept any more data.
+   * @param src Source stream
+   * @param dst Destination
+   * @param max Maximum number of bytes to transfer
+   * @return Statistics of the transfer
+   */
+  template <typename Src, typename Dst>
+  PumpResult pump(Src& src, Dst& dst, size_t max = SIZE_MAX) {
+    uint32_t start = micros();
+    result.bytes = transfer(src, dst, max, PriorityHigh());
+    result.durationUs = micros() - start;
+    ESP_LOGD(TAG, "pumped %u bytes in %u us", (unsigned)result.bytes,
+             (unsigned)result.durationUs);
+    return result;
+  }
+
+  /**
+   * @brief Get the statistics of the last transfer
+   * @return Statistics of the last transfer
+   */
+  PumpResult lastResult() const { return result; }
+
+  /**
+   * @brief Release the internal copy buffer
+   */
+  void end() {
+    buffer.clear();
+    buffer.shrink_to_fit();
+  }
+
+ protected:
+  std::vector<uint8_t> buffer;
+  size_t buffer_size;
+  PumpResult result;
+  static constexpr const char* TAG = "StreamPump";
+
+  /// Tag types to rank the transfer implementations
+  struct PriorityLow {};
+  struct PriorityMedium : PriorityLow {};
+  struct PriorityHigh : PriorityMedium {};
+
+  /// true if Dst overrides availableForWrite(): then 0 means that it is
+  /// full. The Print default returns 0 because it does not know the space,
+  /// so a write may block but does not drop data.
+  template <typename Dst>
+  static constexpr bool reportsSpace() {
+    return !std::is_same<decltype(&Dst::availableForWrite),
+                         int (Print::*)()>::value;
+  }
+
+  /// Source can write its data directly
+  template <typename Src, typename Dst>
+  auto transfer(Src& src, Dst& dst, size_t max, PriorityHigh)
+      -> decltype(src.writeTo(dst, max)) {
+    return src.writeTo(dst, max);
+  }
+
+  /// Destination can read the data directly
+  template <typename Src, typename Dst>
+  auto transfer(Src& src, Dst& dst, size_t max, PriorityMedium)
+      -> decltype(dst.readFrom(src, max)) {
+    return dst.readFrom(src, max);
+  }
+
+  /// Chunked copy via the internal buffer
+  template <typename Src, typename Dst>
+  size_t transfer(Src& src, Dst& dst, size_t max, PriorityLow) {
+    if (buffer.size() != buffer_size) buffer.resize(buffer_size);
+    size_t total = 0;
+    while (total < max) {
+      int available = src.available();
+      if (available <= 0) break;
+      size_t len = std::min(std::min(max - total, (size_t)available),
+                            buffer.size());
+      if (reportsSpace<Dst>()) {
+        // never read more than the destination accepts
+        int space = dst.availableForWrite();
+        if (space <= 0) break;
+        len = std::min(len, (size_t)space);
+      }
+      // fs::File only declares readBytes(char*), which hides the Stream one
+      len = src.readBytes(reinterpret_cast<char*>(buffer.data()), len);
+      if (len == 0) break;
+      size_t written = 0;
+      while (written < len) {
+        size_t n = dst.write(buffer.data() + written, len - written);
+        if (n == 0) break;
+        written += n;
+      }
+      total += written;
+      if (written < len) {
+        ESP_LOGW(TAG, "destination full: %u bytes lost",
+                 (unsigned)(len - written));
+        break;
+      }
+    }
+    return total;
+  }
+};
+
+/**
+ * @brief Copy data from src to dst using a temporary StreamPump
+ *
+ * Use a StreamPump object instead if you need to copy repeatedly, so that
+ * the copy buffer is reused.
+ * @param src Source stream
+ * @param dst Destination
+ * @param max Maximum number of bytes to transfer
+ * @return Statistics of the transfer
+ */
+template <typename Src, typename Dst>
+PumpResult pump(Src& src, Dst& dst, size_t max = SIZE_MAX) {
+  StreamPump pump;
+  return pump.pump(src, dst, max);
+}
+
+}  // namespace esp32_psram
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <utility>
+
+#include "TypedRingBuffer.h"
+
+namespace esp32_psram {
+
+/**
+ * @struct TimestampOf
+ * @brief Default key extractor for TimedRingBuffer: uses value.timestamp
+ * @tparam T The record type
+ */
+template <typename T>
+struct TimestampOf {
+  auto operator()(const T& value) const -> decltype(value.timestamp) {
+    return value.timestamp;
+  }
+};
+
+/**
+ * @struct TimeRange
+ * @brief A range of records in a TimedRingBuffer
+ *
+ * The range is defined by the relative index of the first record from the
+ * read position and the number of records.
+ */
+struct TimeRange {
+  /// Relative index of the first record
+  size_t index = 0;
+  /// Number of records in the range
+  size_t count = 0;
+};
+
+/**
+ * @class TimedRingBuffer
+ * @brief A TypedRingBuffer of time-ordered records with search by time
+ * @tparam T The record type
+ * @tparam VectorType The vector type to use as underlying storage
+ * @tparam KeyOf Functor which returns the timestamp of a record (by default
+ * the timestamp member)
+ *
+ * Records must be added in non-decreasing timestamp order; records which are
+ * older than the last record are rejected. So the buffer content is sorted
+ * and lowerBound(), upperBound() and range() can use a binary search over
+ * the logical indexes, which needs O(log n) element reads instead of a scan.
+ * For RAM and PSRAM storage rangeSegments() returns the records of a time
+ * range as spans without copying.
+ */
+template <typename T, typename VectorType, typename KeyOf = TimestampOf<T>>
+class TimedRingBuffer : public TypedRingBuffer<T, VectorType> {
+  using Base = TypedRingBuffer<T, VectorType>;
+
+ public:
+  /// Type of the timestamp
+  using key_type =
+      typename std::decay<decltype(KeyOf()(std::declval<const T&>()))>::type;
+
+  /**
+   * @brief Constructor with specified buffer capacity
+   * @param capacity The maximum number of records the buffer can hold
+   * @param keyOf Functor to determine the timestamp of a record
+   */
+  TimedRingBuffer(size_t capacity, KeyOf keyOf = KeyOf())
+      : Base(capacity), key_of(keyOf) {}
+
+  /**
+   * @brief Add a record
+   * @param value The record to add
+   * @return true if the record was added, false if the buffer is full or the
+   * record is older than the last record
+   */
+  bool push(const T& value) {
+    return isInOrder(value) && Base::push(value) && updateLast(value);
+  }
+
+  /**
+   * @brief Add a record by moving it
+   * @param value The record to add
+   * @return true if the record was added, false if the buffer is full or the
+   * record is older than the last record
+   */
+  bool push(T&& value) {
+    if (!isInOrder(value)) return false;
+    key_type key = key_of(value);
+    if (!Base::push(std::move(value))) return false;
+    last_key = key;
+    has_last = true;
+    return true;
+  }
+
+  /**
+   * @brief Construct a record from the arguments and add it
+   * @param args Arguments to forward to the constructor of T
+   * @return true if the record was added
+   */
+  template <typename... Args>
+  bool emplace(Args&&... args) {
+    return push(T(std::forward<Args>(args)...));
+  }
+
+  /**
+   * @brief Add a record, overwriting the oldest record if the buffer is full
+   * @param value The record to add
+   * @return true if an old record was overwritten, false otherwise (also if
+   * the record was rejected because it is older than the last record)
+   */
+  bool pushOverwrite(const T& value) {
+    if (!isInOrder(value)) return false;
+    bool result = Base::pushOverwrite(value);
+    updateLast(value);
+    return result;
+  }
+
+  /**
+   * @brief Add multiple records
+   * @param values Pointer to the records to add
+   * @param count Number of records
+   * @return Number of records added; stops at the first record which is
+   * out of order
+   */
+  size_t pushN(const T* values, size_t count) {
+    size_t ordered = 0;
+    key_type last = last_key;
+    bool valid = has_last;
+    while (ordered < count && (!valid || !(key_of(values[ordered]) < last))) {
+      last = key_of(values[ordered]);
+      valid = true;
+      ordered++;
+    }
+    size_t result = Base::pushN(values, ordered);
+    if (result > 0) updateLast(values[result - 1]);
+    return result;
+  }
+
+  /**
+   * @brief Clear the buffer, removing all records
+   */
+  void clear() {
+    Base::clear();
+    has_last = false;
+  }
+
+  /**
+   * @brief Find the first record with a timestamp >= time
+   * @param time The timestamp to search for
+   * @return Relative index of the record, or available() if there is none
+   */
+  size_t lowerBound(const key_type& time) const {
+    return bound(time, false);
+  }
+
+  /**
+   * @brief Find the first record with a timestamp > time
+   * @param time The timestamp to search for
+   * @return Relative index of the record, or available() if there is none
+   */
+  size_t upperBound(const key_type& time) const {
+    return bound(time, true);
+  }
+
+  /**
+   * @brief Determine the records with a timestamp in [from, to]
+   * @param from Start time (inclusive)
+   * @param to End time (inclusive)
+   * @return The range of matching records
+   */
+  TimeRange range(const key_type& from, const key_type& to) const {
+    TimeRange result;
+    result.index = lowerBound(from);
+    size_t end = upperBound(to);
+    result.count = end > result.index ? end - result.index : 0;
+    return result;
+  }
+
+  /**
+   * @brief Get zero-copy access to the records with a timestamp in [from, to]
+   *
+   * Only available for contiguous storage (RAM and PSRAM).
+   * @param from Start time (inclusive)
+   * @param to End time (inclusive)
+   * @return The (up to) two contiguous parts of the matching records
+   */
+  RingSegments<const T> rangeSegments(const key_type& from,
+                                      const key_type& to) const {
+    TimeRange r = range(from, to);
+    return Base::segments(r.index, r.count);
+  }
+
+ protected:
+  KeyOf key_of;
+  key_type last_key{};
+  bool has_last = false;
+
+  bool isInOrder(const T& value) const {
+    return !has_last || !(key_of(value) < last_key);
+  }
+
+  bool updateLast(const T& value) {
+    last_key = key_of(value);
+    has_last = true;
+    return true;
+  }
+
+  /**
+   * @brief Binary search over the relative indexes
+   * @param time The timestamp to search for
+   * @param upper false: first key >= time, true: first key > time
+   */
+  size_t bound(const key_type& time, bool upper) const {
+    size_t low = 0;
+    size_t high = Base::available();
+    while (low < high) {
+      size_t mid = low + (high - low) / 2;
+      // only the key is copied (for RAM and PSRAM storage)
+      key_type key = key_of(Base::elementAt(mid));
+      bool before = upper ? !(time < key) : key < time;
+      if (before) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    return low;
+  }
+};
+
+/**
+ * @brief Type alias for a timed ring buffer that uses std::vector (in RAM)
+ */
+template <typename T, typename KeyOf = TimestampOf<T>>
+using TimedRingBufferRAM = TimedRingBuffer<T, std::vector<T>, KeyOf>;
+
+/**
+ * @brief Type alias for a timed ring buffer that uses PSRAM-backed storage
+ */
+template <typename T, typename KeyOf = TimestampOf<T>>
+using TimedRingBufferPSRAM = TimedRingBuffer<T, VectorPSRAM<T>, KeyOf>;
+
+/**
+ * @brief Type alias for a timed ring buffer that uses HIMEM-backed storage
+ */
+template <typename T, typename KeyOf = TimestampOf<T>>
+using TimedRingBufferHIMEM = TimedRingBuffer<T, VectorHIMEM<T>, KeyOf>;
+
+}  // namespace esp32_psram
@@ -2,9 +2,13 @@
 #pragma once
 
 #include <Arduino.h>
+#include <utility>
 #include <vector>
 #include "VectorPSRAM.h"
 #include "VectorHIMEM.h"
+#include "RingIterator.h"
+#include "RingStorage.h"
+#include "Span.h"
 
 namespace esp32_psram {
 
@@ -16,23 +20,114 @@ namespace esp32_psram {
  * 
  * This class implements a ring buffer (circular buffer) that uses a vector container
  * for storage. Unlike the Stream-based RingBuffer, this can store any data type.
+ *
+ * Besides single element access, pushN() and popN() transfer whole blocks with
+ * at most two contiguous segment copies (window copies for HIMEM).
+ *
+ * The memory is allocated uninitialized: elements are only constructed when
+ * they are pushed and destroyed when they are popped or cleared. So creating
+ * a large buffer is O(1) and T does not need to be default-constructible;
+ * move-only types are supported as well. HIMEM storage only supports plain
+ * data types which can be copied with memcpy.
+ *
+ * The content can be processed without copies with the begin()/end()
+ * iterators (oldest element first) or, for RAM and PSRAM storage, with the
+ * (up to) two contiguous spans returned by segments().
  */
 template <typename T, typename VectorType>
 class TypedRingBuffer {
 private:
-    VectorType buffer;
+    RingStorage<T, VectorType> buffer;
     size_t readIndex = 0;
     size_t writeIndex = 0;
     bool full = false;
     size_t maxSize;
 
 public:
+    /**
+     * @brief Random access iterator over the elements, oldest first
+     *
+     * The iterator is invalidated when elements are removed. For HIMEM storage
+     * the elements are returned by value.
+     */
+    using const_iterator = RingIterator<TypedRingBuffer, T,
+        decltype(std::declval<const RingStorage<T, VectorType>&>().get(0))>;
+    using iterator = const_iterator;
+
     /**
      * @brief Constructor with specified buffer capacity
-     * @param capacity The maximum number of elements the buffer can hold
+     * @param capacity The maximum number of elements the buffer can hold; a
+     * buffer with capacity 0 is always full and empty
+     */
+    TypedRingBuffer(size_t capacity) : buffer(capacity), maxSize(capacity) {}
+
+    /**
+     * @brief Copy constructor - copies the stored elements
+     * @param other The buffer to copy from
+     */
+    TypedRingBuffer(const TypedRingBuffer& other)
+        : buffer(other.maxSize), maxSize(other.maxSize) {
+        size_t count = other.available();
+        size_t first = std::min(count, maxSize - other.readIndex);
+        buffer.copyFrom(0, other.buffer, other.readIndex, first);
+        buffer.copyFrom(first, other.buffer, 0, count - first);
+        writeIndex = maxSize > 0 ? count % maxSize : 0;
+        full = other.full;
+    }
+
+    /**
+     * @brief Move constructor
+     * @param other The buffer to move from
      */
-    TypedRingBuffer(size_t capacity) : maxSize(capacity) {
-        buffer.resize(capacity);
+    TypedRingBuffer(TypedRingBuffer&& other) noexcept
+        : buffer(std::move(other.buffer)),
+          readIndex(other.readIndex),
+          writeIndex(other.writeIndex),
+          full(other.full),
+          maxSize(other.maxSize) {
+        other.readIndex = other.writeIndex = 0;
+        other.full = false;
+        other.maxSize = 0;
+    }
+
+    /**
+     * @brief Copy assignment operator
+     * @param other The buffer to copy from
+     * @return Reference to this buffer
+     */
+    TypedRingBuffer& operator=(const TypedRingBuffer& other) {
+        if (this != &other) {
+            TypedRingBuffer copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Move assignment operator
+     * @param other The buffer to move from
+     * @return Reference to this buffer
+     */
+    TypedRingBuffer& operator=(TypedRingBuffer&& other) noexcept {
+        if (this != &other) {
+            clear();
+            buffer = std::move(other.buffer);
+            readIndex = other.readIndex;
+            writeIndex = other.writeIndex;
+            full = other.full;
+            maxSize = other.maxSize;
+            other.readIndex = other.writeIndex = 0;
+            other.full = false;
+            other.maxSize = 0;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Destructor - destroys the stored elements
+     */
+    ~TypedRingBuffer() {
+        clear();
     }
 
     /**
@@ -41,24 +136,76 @@ public:
      * @return true if the element was added, false if the buffer is full
      */
     bool push(const T& value) {
-        if (full) {
+        if (isFull()) {
             return false;
         }
 
-        buffer[writeIndex] = value;
+        buffer.construct(writeIndex, value);
         advanceWriteIndex();
         return true;
     }
 
+    /**
+     * @brief Push an element to the buffer by moving it
+     * @param value The value to add
+     * @return true if the element was added, false if the buffer is full
+     */
+    bool push(T&& value) {
+        if (isFull()) {
+            return false;
+        }
+
+        buffer.construct(writeIndex, std::move(value));
+        advanceWriteIndex();
+        return true;
+    }
+
+    /**
+     * @brief Construct an element from the arguments and add it to the buffer
+     * @param args Arguments to forward to the constructor of T
+     * @return true if the element was added, false if the buffer is full
+     */
+    template <typename... Args>
+    bool emplace(Args&&... args) {
+        if (isFull()) {
+            return false;
+        }
+
+        buffer.construct(writeIndex, std::forward<Args>(args)...);
+        advanceWriteIndex();
+        return true;
+    }
+
+    /**
+     * @brief Push multiple elements to the buffer
+     * @param values Pointer to the elements to add
+     * @param count Number of elements to add
+     * @return Number of elements added (limited by the free space)
+     */
+    size_t pushN(const T* values, size_t count) {
+        count = std::min(count, availableForWrite());
+        size_t first = std::min(count, maxSize - writeIndex);
+        buffer.copyIn(writeIndex, values, first);
+        buffer.copyIn(0, values + first, count - first);
+        advanceWriteIndex(count);
+        return count;
+    }
+
     /**
      * @brief Push an element to the buffer, overwriting oldest data if full
      * @param value The value to add
-     * @return true if an old element was overwritten, false otherwise
+     * @return true if an old element was overwritten, false otherwise (also
+     * if the capacity is 0 and nothing was added)
      */
     bool pushOverwrite(const T& value) {
+        if (maxSize == 0) return false;
         bool overwritten = full;
         
-        buffer[writeIndex] = value;
+        if (full) {
+            buffer.destroy(readIndex, 1);
+            advanceReadIndex();
+        }
+        buffer.construct(writeIndex, value);
         advanceWriteIndex();
         
         return overwritten;
@@ -74,11 +221,26 @@ public:
             return false;
         }
 
-        value = buffer[readIndex];
+        buffer.moveOut(readIndex, &value, 1);
         advanceReadIndex();
         return true;
     }
 
+    /**
+     * @brief Pop multiple elements from the buffer
+     * @param values Pointer to the destination for the popped elements
+     * @param count Maximum number of elements to pop
+     * @return Number of elements popped (limited by the available elements)
+     */
+    size_t popN(T* values, size_t count) {
+        count = std::min(count, available());
+        size_t first = std::min(count, maxSize - readIndex);
+        buffer.moveOut(readIndex, values, first);
+        buffer.moveOut(0, values + first, count - first);
+        advanceReadIndex(count);
+        return count;
+    }
+
     /**
      * @brief Peek at the next element without removing it
      * @param value Reference to store the peeked value
@@ -89,7 +251,7 @@ public:
             return false;
         }
 
-        value = buffer[readIndex];
+        buffer.copyOut(readIndex, &value, 1);
         return true;
     }
 
@@ -105,14 +267,67 @@ public:
         }
 
         size_t actualIndex = (readIndex + index) % maxSize;
-        value = buffer[actualIndex];
+        buffer.copyOut(actualIndex, &value, 1);
         return true;
     }
 
+    /**
+     * @brief Get zero-copy access to a range of elements
+     *
+     * Only available for contiguous storage (RAM and PSRAM). The spans are
+     * invalidated when elements are removed from or added to the buffer.
+     * @param index The relative index of the first element from the read position
+     * @param count Number of elements (limited to the available elements)
+     * @return The (up to) two contiguous parts of the range
+     */
+    RingSegments<const T> segments(size_t index, size_t count) const {
+        size_t size = available();
+        if (index >= size) {
+            return RingSegments<const T>();
+        }
+        count = std::min(count, size - index);
+        size_t start = readIndex + index;
+        if (start >= maxSize) start -= maxSize;
+        size_t first = std::min(count, maxSize - start);
+        const T* data = buffer.data();
+        return RingSegments<const T>(Span<const T>(data + start, first),
+                                     Span<const T>(data, count - first));
+    }
+
+    /**
+     * @brief Get zero-copy access to all elements
+     *
+     * Only available for contiguous storage (RAM and PSRAM).
+     * @return The (up to) two contiguous parts of the content, oldest first
+     */
+    RingSegments<const T> segments() const {
+        return segments(0, available());
+    }
+
+    /**
+     * @brief Get an iterator to the oldest element
+     * @return Iterator to the first element
+     */
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    /**
+     * @brief Get an iterator past the newest element
+     * @return Iterator to one past the last element
+     */
+    const_iterator end() const {
+        return const_iterator(this, available());
+    }
+
     /**
      * @brief Clear the buffer, removing all content
      */
     void clear() {
+        size_t count = available();
+        size_t first = std::min(count, maxSize - readIndex);
+        buffer.destroy(readIndex, first);
+        buffer.destroy(0, count - first);
         readIndex = 0;
         writeIndex = 0;
         full = false;
@@ -131,7 +346,8 @@ public:
      * @return true if the buffer is full, false otherwise
      */
     bool isFull() const {
-        return full;
+        // also a moved-from buffer has no slots
+        return full || maxSize == 0;
     }
 
     /**
@@ -165,28 +381,30 @@ public:
         return maxSize;
     }
 
-    /**
-     * @brief Get direct access to the underlying vector
-     * @return Reference to the underlying vector
-     */
-    VectorType& getVector() {
-        return buffer;
-    }
+protected:
+    friend const_iterator;
 
     /**
-     * @brief Get const access to the underlying vector
-     * @return Const reference to the underlying vector
+     * @brief Access an element by its relative index without bounds checking
+     * @param index The relative index from the current read position
+     * @return The element (a reference for RAM and PSRAM storage)
      */
-    const VectorType& getVector() const {
-        return buffer;
+    typename const_iterator::reference elementAt(size_t index) const {
+        size_t actualIndex = readIndex + index;
+        if (actualIndex >= maxSize) actualIndex -= maxSize;
+        return buffer.get(actualIndex);
     }
 
 private:
+
     /**
      * @brief Advance the write index
+     * @param count Number of elements
      */
-    void advanceWriteIndex() {
-        writeIndex = (writeIndex + 1) % maxSize;
+    void advanceWriteIndex(size_t count = 1) {
+        if (count == 0) return;
+        writeIndex += count;
+        if (writeIndex >= maxSize) writeIndex -= maxSize;
         if (writeIndex == readIndex) {
             full = true;
         }
@@ -194,9 +412,12 @@ private:
 
     /**
      * @brief Advance the read index
+     * @param count Number of elements
      */
-    void advanceReadIndex() {
-        readIndex = (readIndex + 1) % maxSize;
+    void advanceReadIndex(size_t count = 1) {
+        if (count == 0) return;
+        readIndex += count;
+        if (readIndex >= maxSize) readIndex -= maxSize;
         full = false;
     }
 };
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <algorithm>
+#include <type_traits>
+
+#include "VectorHIMEM.h"
+
+namespace esp32_psram {
+
+/**
+ * @file VectorAccess.h
+ * @brief Bulk access to the elements of the supported vector types
+ *
+ * The containers in this library can be used with std::vector, VectorPSRAM
+ * and VectorHIMEM. The first two provide contiguous memory via data(), while
+ * VectorHIMEM can only be accessed through its mapped 32K window. These
+ * functions hide the difference, so that containers can move data with
+ * memcpy sized copies instead of element by element.
+ */
+
+/**
+ * @brief Copy elements out of a vector with contiguous storage
+ * @param vec Source vector
+ * @param pos Index of the first element
+ * @param dest Destination buffer
+ * @param count Number of elements to copy
+ * @return Number of elements copied
+ */
+template <typename VectorType, typename T>
+size_t bulkRead(const VectorType& vec, size_t pos, T* dest, size_t count) {
+  if (pos >= vec.size()) return 0;
+  count = std::min(count, vec.size() - pos);
+  std::copy_n(vec.data() + pos, count, dest);
+  return count;
+}
+
+/**
+ * @brief Copy elements out of a VectorHIMEM using window copies
+ * @param vec Source vector
+ * @param pos Index of the first element
+ * @param dest Destination buffer
+ * @param count Number of elements to copy
+ * @return Number of elements copied
+ */
+template <typename T>
+size_t bulkRead(const VectorHIMEM<T>& vec, size_t pos, T* dest, size_t count) {
+  return vec.read(dest, pos, count);
+}
+
+/**
+ * @brief Overwrite elements of a vector with contiguous storage
+ * @param vec Destination vector
+ * @param pos Index of the first element
+ * @param src Source buffer
+ * @param count Number of elements to copy
+ * @return Number of elements copied
+ */
+template <typename VectorType, typename T>
+size_t bulkWrite(VectorType& vec, size_t pos, const T* src, size_t count) {
+  if (pos >= vec.size()) return 0;
+  count = std::min(count, vec.size() - pos);
+  std::copy_n(src, count, vec.data() + pos);
+  return count;
+}
+
+/**
+ * @brief Overwrite elements of a VectorHIMEM using window copies
+ * @param vec Destination vector
+ * @param pos Index of the first element
+ * @param src Source buffer
+ * @param count Number of elements to copy
+ * @return Number of elements copied
+ */
+template <typename T>
+size_t bulkWrite(VectorHIMEM<T>& vec, size_t pos, const T* src, size_t count) {
+  return vec.write(src, pos, count);
+}
+
+/**
+ * @brief Move elements out of a vector with contiguous storage
+ * @param vec Source vector
+ * @param pos Index of the first element
+ * @param dest Destination buffer
+ * @param count Number of elements to move
+ * @return Number of elements moved
+ */
+template <typename VectorType, typename T>
+size_t bulkMoveOut(VectorType& vec, size_t pos, T* dest, size_t count) {
+  if (pos >= vec.size()) return 0;
+  count = std::min(count, vec.size() - pos);
+  std::move(vec.data() + pos, vec.data() + pos + count, dest);
+  return count;
+}
+
+/**
+ * @brief Move elements out of a VectorHIMEM (which only holds plain data)
+ * @param vec Source vector
+ * @param pos Index of the first element
+ * @param dest Destination buffer
+ * @param count Number of elements to move
+ * @return Number of elements moved
+ */
+template <typename T>
+size_t bulkMoveOut(VectorHIMEM<T>& vec, size_t pos, T* dest, size_t count) {
+  return vec.read(dest, pos, count);
+}
+
+/**
+ * @brief Move elements into a vector with contiguous storage
+ * @param vec Destination vector
+ * @param pos Index of the first element
+ * @param src Source buffer
+ * @param count Number of elements to move
+ * @return Number of elements moved
+ */
+template <typename VectorType, typename T>
+size_t bulkMoveIn(VectorType& vec, size_t pos, T* src, size_t count) {
+  if (pos >= vec.size()) return 0;
+  count = std::min(count, vec.size() - pos);
+  std::move(src, src + count, vec.data() + pos);
+  return count;
+}
+
+/**
+ * @brief Move elements into a VectorHIMEM (which only holds plain data)
+ * @param vec Destination vector
+ * @param pos Index of the first element
+ * @param src Source buffer
+ * @param count Number of elements to move
+ * @return Number of elements moved
+ */
+template <typename T>
+size_t bulkMoveIn(VectorHIMEM<T>& vec, size_t pos, T* src, size_t count) {
+  return vec.write(src, pos, count);
+}
+
+/**
+ * @brief Append elements to a vector with contiguous storage
+ * @param vec Destination vector
+ * @param src Source buffer
+ * @param count Number of elements to append
+ * @return Number of elements appended
+ */
+template <typename VectorType, typename T>
+size_t bulkAppend(VectorType& vec, const T* src, size_t count) {
+  vec.insert(vec.end(), src, src + count);
+  return count;
+}
+
+/**
+ * @brief Append elements to a VectorHIMEM using window copies
+ * @param vec Destination vector
+ * @param src Source buffer
+ * @param count Number of elements to append
+ * @return Number of elements appended
+ */
+template <typename T>
+size_t bulkAppend(VectorHIMEM<T>& vec, const T* src, size_t count) {
+  return vec.append(src, count);
+}
+
+/**
+ * @brief Get a pointer to the elements of a vector with contiguous storage
+ * @param vec The vector
+ * @param pos Index of the first element
+ * @param count In: requested number of elements, Out: number of elements
+ * accessible via the returned pointer
+ * @return Pointer to the element at pos, or nullptr
+ */
+template <typename VectorType>
+auto bulkPointer(VectorType& vec, size_t pos, size_t& count)
+    -> decltype(vec.data()) {
+  if (pos >= vec.size()) {
+    count = 0;
+    return nullptr;
+  }
+  count = std::min(count, vec.size() - pos);
+  return vec.data() + pos;
+}
+
+/**
+ * @brief Get a pointer into the mapped window of a VectorHIMEM
+ *
+ * The result is limited to the current 32K window and is only valid until
+ * the vector is accessed again.
+ * @param vec The vector
+ * @param pos Index of the first element
+ * @param count In: requested number of elements, Out: number of elements
+ * accessible via the returned pointer
+ * @return Pointer to the element at pos, or nullptr
+ */
+template <typename T>
+T* bulkPointer(VectorHIMEM<T>& vec, size_t pos, size_t& count) {
+  return vec.window(pos, count);
+}
+
+/**
+ * @brief Trait which tells if several tasks can read a vector at the same time
+ *
+ * Reading a VectorHIMEM maps a window, which changes its state, so reads
+ * need to be exclusive.
+ */
+template <typename VectorType>
+struct SharedReadAccess : std::true_type {};
+
+template <typename T>
+struct SharedReadAccess<VectorHIMEM<T>> : std::false_type {};
+
+/**
+ * @brief Release resources which are held for direct access (no-op for
+ * vectors with contiguous storage)
+ * @param vec The vector
+ */
+template <typename VectorType>
+void releaseWindow(VectorType&) {}
+
+/**
+ * @brief Unmap the HIMEM window of a VectorHIMEM
+ * @param vec The vector
+ */
+template <typename T>
+void releaseWindow(VectorHIMEM<T>& vec) {
+  vec.unmap();
+}
+
+/**
+ * @brief Prepare a range for writing via bulkPointer() (no-op for vectors
+ * which do not share their storage)
+ * @param vec The vector
+ * @param pos Index of the first element
+ * @param count Number of elements
+ * @return true if the range can be written
+ */
+template <typename VectorType>
+bool makeWritable(VectorType&, size_t, size_t) {
+  return true;
+}
+
+}  // namespace esp32_psram
@@ -412,6 +412,89 @@ class VectorHIMEM {
     ++element_count;
   }
 
+  /**
+   * @brief Read multiple elements with a single (window based) copy
+   * @param dest Destination buffer
+   * @param pos Index of the first element to read
+   * @param count Number of elements to read
+   * @return Number of elements actually read
+   */
+  size_t read(T* dest, size_type pos, size_type count) const {
+    if (pos >= element_count) return 0;
+    count = std::min(count, element_count - pos);
+    HimemBlock& non_const_memory = const_cast<HimemBlock&>(memory);
+    return non_const_memory.read(dest, pos * sizeof(T), count * sizeof(T)) /
+           sizeof(T);
+  }
+
+  /**
+   * @brief Overwrite multiple elements with a single (window based) copy
+   * @param src Source buffer
+   * @param pos Index of the first element to write
+   * @param count Number of elements to write
+   * @return Number of elements actually written
+   */
+  size_t write(const T* src, size_type pos, size_type count) {
+    if (pos >= element_count) return 0;
+    count = std::min(count, element_count - pos);
+    return memory.write(src, pos * sizeof(T), count * sizeof(T)) / sizeof(T);
+  }
+
+  /**
+   * @brief Append multiple elements with a single (window based) copy
+   * @param src Source buffer
+   * @param count Number of elements to append
+   * @return Number of elements actually appended
+   */
+  size_t append(const T* src, size_type count) {
+    size_t required = element_count + count;
+    if (required > element_capacity) {
+      size_t new_capacity = std::max(required, element_capacity * 2);
+      if (!reallocate(new_capacity)) {
+        ESP_LOGE(TAG, "Failed to reallocate for append");
+        return 0;
+      }
+    }
+    size_t written =
+        memory.write(src, element_count * sizeof(T), count * sizeof(T)) /
+        sizeof(T);
+    element_count += written;
+    return written;
+  }
+
+  /**
+   * @brief Get direct access to the elements in the currently mapped window
+   *
+   * Maps the HIMEM window which contains the element at pos and returns a
+   * pointer into it. The pointer is only valid until the next access to this
+   * vector, which might map a different window.
+   * @param pos Index of the first element
+   * @param count In: requested number of elements, Out: number of elements
+   * which are contiguously accessible via the returned pointer
+   * @return Pointer to the element at pos or nullptr if it is not accessible
+   */
+  T* window(size_type pos, size_type& count) {
+    void* address = nullptr;
+    size_t available = 0;
+    if (pos >= element_count ||
+        !memory.getAddress(pos * sizeof(T), address, available)) {
+      count = 0;
+      return nullptr;
+    }
+    count = std::min(std::min(count, element_count - pos),
+                     available / sizeof(T));
+    return count > 0 ? static_cast<T*>(address) : nullptr;
+  }
+
+  /**
+   * @brief Release the mapped HIMEM window
+   *
+   * Each vector keeps its current window mapped, but the number of map
+   * ranges is limited. Containers which hold many vectors release the
+   * window of a vector when they switch to another one.
+   */
+  void unmap() { memory.unmap(); }
+
   /**
    * @brief Swap the contents of this vector with another
    * @param other Vector to swap with
@@ -457,16 +540,16 @@ class VectorHIMEM {
       return false;
     }
 
-    // Copy existing elements if any
-    if (element_count > 0) {
-      T temp;
-      for (size_t i = 0; i < element_count; ++i) {
-        // Read from old memory
-        memory.read(&temp, i * sizeof(T), sizeof(T));
-
-        // Write to new memory
-        new_memory.write(&temp, i * sizeof(T), sizeof(T));
-      }
+    // Copy existing elements if any: one copy per mapped window
+    size_t offset = 0;
+    size_t total = calculate_size_bytes(element_count);
+    while (offset < total) {
+      void* window = nullptr;
+      size_t available = 0;
+      if (!memory.getAddress(offset, window, available)) break;
+      size_t len = std::min(available, total - offset);
+      new_memory.write(window, offset, len);
+      offset += len;
     }
 
     // Swap the memory blocks
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <math.h>
+
+#include <vector>
+
+#include "TypedRingBuffer.h"
+
+namespace esp32_psram {
+
+/**
+ * @class WindowedStats
+ * @brief Incremental statistics over the last N samples
+ * @tparam T The (numeric) sample type
+ * @tparam VectorType The vector type which stores the samples
+ * @tparam IndexVectorType The vector type which stores the min/max indexes
+ *
+ * The samples are kept in a TypedRingBuffer which represents the sliding
+ * window. Each added sample updates the statistics incrementally and evicts
+ * the oldest sample when the window is full, so the cost per sample is O(1)
+ * amortised, independent of the window size:
+ * - sum, mean and variance are based on running sums
+ * - minimum and maximum use monotonic queues of sample indexes
+ * - percentiles are estimated from an optional fixed-bin histogram (see
+ *   setHistogram()) which is updated on add and evict.
+ *
+ * To limit the accumulation of rounding errors the running sums are
+ * recalculated from the window after each full window of evictions.
+ */
+template <typename T, typename VectorType, typename IndexVectorType>
+class WindowedStats {
+ public:
+  /**
+   * @brief Constructor
+   * @param windowSize Number of samples in the window
+   */
+  WindowedStats(size_t windowSize)
+      : samples(windowSize),
+        minQueue(windowSize),
+        maxQueue(windowSize),
+        window_size(windowSize) {}
+
+  /**
+   * @brief Add a sample, evicting the oldest sample if the window is full
+   * @param value The sample
+   */
+  void add(const T& value) {
+    if (window_size == 0) return;
+    if (samples.isFull()) evict();
+
+    samples.push(value);
+    double v = static_cast<double>(value);
+    sum_ += v;
+    sum_sq += v * v;
+    histogramUpdate(v, 1);
+
+    uint32_t seq = next_seq++;
+    // keep the queues monotonic: drop entries which can't become min/max
+    while (!minQueue.isEmpty() && !(valueAt(minQueue.back()) < value)) {
+      minQueue.popBack();
+    }
+    minQueue.pushBack(seq);
+    while (!maxQueue.isEmpty() && !(value < valueAt(maxQueue.back()))) {
+      maxQueue.popBack();
+    }
+    maxQueue.pushBack(seq);
+  }
+
+  /**
+   * @brief Remove all samples
+   */
+  void clear() {
+    samples.clear();
+    minQueue.clear();
+    maxQueue.clear();
+    sum_ = sum_sq = 0.0;
+    first_seq = next_seq = 0;
+    evictions = 0;
+    std::fill(histogram.begin(), histogram.end(), 0);
+  }
+
+  /**
+   * @brief Get the number of samples in the window
+   * @return Number of samples
+   */
+  size_t count() const { return samples.available(); }
+
+  /**
+   * @brief Check if the window is empty
+   * @return true if there are no samples
+   */
+  bool isEmpty() const { return samples.isEmpty(); }
+
+  /**
+   * @brief Get the window size
+   * @return Maximum number of samples in the window
+   */
+  size_t windowSize() const { return window_size; }
+
+  /**
+   * @brief Get the sum of the samples in the window
+   * @return Sum of the samples
+   */
+  double sum() const { return sum_; }
+
+  /**
+   * @brief Get the arithmetic mean of the samples in the window
+   * @return Mean value, or 0 if the window is empty
+   */
+  double mean() const { return isEmpty() ? 0.0 : sum_ / count(); }
+
+  /**
+   * @brief Get the (population) variance of the samples in the window
+   * @return Variance, or 0 if the window is empty
+   */
+  double variance() const {
+    if (isEmpty()) return 0.0;
+    double m = mean();
+    double result = sum_sq / count() - m * m;
+    return result > 0.0 ? result : 0.0;
+  }
+
+  /**
+   * @brief Get the (population) standard deviation of the samples
+   * @return Standard deviation, or 0 if the window is empty
+   */
+  double stddev() const { return sqrt(variance()); }
+
+  /**
+   * @brief Get the smallest sample in the window
+   * @return Minimum value, or T() if the window is empty
+   */
+  T minimum() const { return minQueue.isEmpty() ? T() : valueAt(minQueue.front()); }
+
+  /**
+   * @brief Get the largest sample in the window
+   * @return Maximum value, or T() if the window is empty
+   */
+  T maximum() const { return maxQueue.isEmpty() ? T() : valueAt(maxQueue.front()); }
+
+  /**
+   * @brief Activate the percentile estimation with a fixed-bin histogram
+   *
+   * Samples below low or above high are counted in the first or last bin.
+   * The precision of percentile() is (high - low) / bins. The samples which
+   * are already in the window are added to the histogram.
+   * @param low Lower bound of the expected value range
+   * @param high Upper bound of the expected value range
+   * @param bins Number of bins (0 deactivates the histogram)
+   */
+  void setHistogram(double low, double high, size_t bins) {
+    hist_low = low;
+    hist_high = high;
+    histogram.assign(bins, 0);
+    for (size_t i = 0; i < count(); i++) {
+      histogramUpdate(static_cast<double>(valueAt(first_seq + i)), 1);
+    }
+  }
+
+  /**
+   * @brief Estimate a percentile of the samples in the window
+   *
+   * Requires an active histogram (see setHistogram()). The cost is
+   * proportional to the number of bins, not to the window size.
+   * @param p Percentile in the range 0 - 100 (e.g. 50 for the median)
+   * @return Estimated value, or 0 if there is no data or histogram
+   */
+  double percentile(double p) const {
+    if (histogram.empty() || isEmpty()) return 0.0;
+    double target = p / 100.0 * count();
+    double width = (hist_high - hist_low) / histogram.size();
+    double cumulative = 0.0;
+    for (size_t i = 0; i < histogram.size(); i++) {
+      uint32_t in_bin = histogram[i];
+      if (in_bin > 0 && cumulative + in_bin >= target) {
+        double fraction = (target - cumulative) / in_bin;
+        return hist_low + (i + fraction) * width;
+      }
+      cumulative += in_bin;
+    }
+    return hist_high;
+  }
+
+  /**
+   * @brief Get access to the samples in the window
+   * @return The ring buffer with the samples, oldest first
+   */
+  const TypedRingBuffer<T, VectorType>& window() const { return samples; }
+
+ protected:
+  /**
+   * @class IndexQueue
+   * @brief Double ended queue of sample indexes with a fixed capacity
+   */
+  class IndexQueue {
+   public:
+    IndexQueue(size_t capacity) : storage(capacity), max_size(capacity) {}
+
+    bool isEmpty() const { return size == 0; }
+    void clear() { head = size = 0; }
+    uint32_t front() const { return at(head); }
+    uint32_t back() const { return at(wrap(head + size - 1)); }
+    void popFront() {
+      head = wrap(head + 1);
+      size--;
+    }
+    void popBack() { size--; }
+    void pushBack(uint32_t value) {
+      storage.copyIn(wrap(head + size), &value, 1);
+      size++;
+    }
+
+   protected:
+    RingStorage<uint32_t, IndexVectorType> storage;
+    size_t max_size;
+    size_t head = 0;
+    size_t size = 0;
+
+    size_t wrap(size_t pos) const {
+      return pos >= max_size ? pos - max_size : pos;
+    }
+    uint32_t at(size_t pos) const {
+      uint32_t result = 0;
+      storage.copyOut(pos, &result, 1);
+      return result;
+    }
+  };
+
+  TypedRingBuffer<T, VectorType> samples;
+  IndexQueue minQueue;
+  IndexQueue maxQueue;
+  size_t window_size;
+  // sequence number of the oldest sample in the window and of the next one
+  uint32_t first_seq = 0;
+  uint32_t next_seq = 0;
+  size_t evictions = 0;
+  double sum_ = 0.0;
+  double sum_sq = 0.0;
+  std::vector<uint32_t> histogram;
+  double hist_low = 0.0;
+  double hist_high = 0.0;
+
+  /**
+   * @brief Get the sample value for a sequence number in the window
+   */
+  T valueAt(uint32_t seq) const {
+    T result{};
+    samples.peekAt(seq - first_seq, result);
+    return result;
+  }
+
+  /**
+   * @brief Remove the oldest sample from the window and the statistics
+   */
+  void evict() {
+    T oldest{};
+    samples.pop(oldest);
+    double v = static_cast<double>(oldest);
+    sum_ -= v;
+    sum_sq -= v * v;
+    histogramUpdate(v, -1);
+    if (!minQueue.isEmpty() && minQueue.front() == first_seq) {
+      minQueue.popFront();
+    }
+    if (!maxQueue.isEmpty() && maxQueue.front() == first_seq) {
+      maxQueue.popFront();
+    }
+    first_seq++;
+
+    if (++evictions >= window_size) {
+      evictions = 0;
+      recalculateSums();
+    }
+  }
+
+  /**
+   * @brief Recalculate the running sums from the samples in the window
+   */
+  void recalculateSums() {
+    sum_ = sum_sq = 0.0;
+    for (size_t i = 0; i < count(); i++) {
+      double v = static_cast<double>(valueAt(first_seq + i));
+      sum_ += v;
+      sum_sq += v * v;
+    }
+  }
+
+  /**
+   * @brief Add or remove a value to/from the histogram
+   */
+  void histogramUpdate(double value, int delta) {
+    if (histogram.empty()) return;
+    double pos = (value - hist_low) / (hist_high - hist_low) * histogram.size();
+    size_t bin = 0;
+    if (pos >= histogram.size()) {
+      bin = histogram.size() - 1;
+    } else if (pos > 0) {
+      bin = static_cast<size_t>(pos);
+    }
+    histogram[bin] += delta;
+  }
+};
+
+/**
+ * @brief Type alias for windowed statistics with the samples in RAM
+ */
+template <typename T>
+using WindowedStatsRAM =
+    WindowedStats<T, std::vector<T>, std::vector<uint32_t>>;
+
+/**
+ * @brief Type alias for windowed statistics with the samples in PSRAM
+ */
+template <typename T>
+using WindowedStatsPSRAM =
+    WindowedStats<T, VectorPSRAM<T>, VectorPSRAM<uint32_t>>;
+
+/**
+ * @brief Type alias for windowed statistics with the samples in HIMEM
+ */
+template <typename T>
+using WindowedStatsHIMEM =
+    WindowedStats<T, VectorHIMEM<T>, VectorHIMEM<uint32_t>>;
+
+}  // namespace esp32_psram